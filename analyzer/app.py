@@ -1,5 +1,9 @@
-from flask import Flask, request, jsonify
+from flask import Flask, request, jsonify, Response
+import functools
 import math
+import msgpack
+
+MSGPACK_TYPES = ("application/msgpack", "application/x-msgpack")
 
 app = Flask(__name__)
 
@@ -128,6 +132,171 @@ def solve_master_theorem(a: float, b: float, f_expr: str):
         "case_reasoning": lines
     }
 
+def solve_decrease(a: float, c: float, f_expr: str):
+    """
+    Solve T(n) = a T(n-c) + f(n) (the parser's "decrease" model).
+    Supports the same f(n) forms as the Master Theorem solver.
+    Returns dict with {recurrence, solution, case_reasoning} or {error: ...}
+    """
+    if not (isinstance(a, (int, float)) and isinstance(c, (int, float))):
+        return {"error": "Invalid a or c."}
+    if a < 1 or c < 1:
+        return {"error": "Decrease model requires a >= 1 and c >= 1."}
+
+    kind, k, f_label = classify_f(f_expr)
+    if kind == "unsupported":
+        return {"error": f"Unsupported f(n): {f_expr}"}
+
+    lines = [f"T(n) = {a}T(n-{c}) + {f_expr}"]
+    if a == 1:
+        # n/c levels, each doing at most f(n): T(n) = Θ(n · f(n))
+        if kind == "const":
+            sol = "O(n)"
+        elif kind == "log":
+            sol = "O(n log n)"
+        elif kind == "n":
+            sol = "O(n^2)"
+        elif kind == "nk":
+            sol = f"O(n^{fmt_exp(float(k) + 1.0)})"
+        else:
+            sol = "O(n^2 log n)"
+        lines.append(f"a = 1: n/{c} levels of f(n) work each, so T(n) = Θ(n · f(n)).")
+    else:
+        sol = f"O({a}^n)" if c == 1 else f"O({a}^(n/{c}))"
+        lines.append(f"a > 1: the call tree has {a}^(n/{c}) leaves, which dominates any polynomial f(n).")
+
+    return {
+        "recurrence": f"T(n) = {a}T(n-{c}) + {f_expr}",
+        "solution": sol,
+        "case_reasoning": lines
+    }
+
+# ==============================
+# Recurrence terms: Akra-Bazzi and linear recurrences
+# ==============================
+
+TERM_LIMIT = 1_000_000  # counts and sizes past this are not a recurrence worth solving
+MAX_TERMS = 8           # distinct sizes, as many as the parser reports
+
+def normalize_terms(terms):
+    """
+    The parser's "terms" ([{"a", "num", "den"} for T(num·n/den), {"a", "c"} for T(n-c)])
+    as a sorted tuple of (num, den, c, a): fractions reduced, equal sizes merged.
+    None unless every term is valid and all are of one kind.
+    """
+    if not isinstance(terms, list) or not terms:
+        return None
+    merged = {}
+    for t in terms:
+        if not isinstance(t, dict):
+            return None
+        a = t.get("a")
+        if type(a) is not int or not 1 <= a <= TERM_LIMIT:
+            return None
+        if "c" in t:
+            c = t["c"]
+            if type(c) is not int or not 1 <= c <= TERM_LIMIT:
+                return None
+            size = (0, 0, c)
+        else:
+            num, den = t.get("num"), t.get("den")
+            if type(num) is not int or type(den) is not int or not 1 <= num < den <= TERM_LIMIT:
+                return None
+            g = math.gcd(num, den)
+            size = (num // g, den // g, 0)
+        merged[size] = merged.get(size, 0) + a
+    if len(merged) > MAX_TERMS or len({size[2] > 0 for size in merged}) > 1:
+        return None
+    return tuple(sorted(size + (a,) for size, a in merged.items()))
+
+def fmt_calls(key) -> str:
+    """The recursive part of T(n), e.g. "T(n/3) + T(2n/3)"."""
+    parts = []
+    for num, den, c, a in key:
+        arg = f"n-{c}" if c else (f"n/{den}" if num == 1 else f"{num}n/{den}")
+        parts.append(f"{a if a != 1 else ''}T({arg})")
+    return " + ".join(parts)
+
+def fmt_growth(p: float, q: int) -> str:
+    """O(n^p log^q n), written the way the Master Theorem solver writes it."""
+    logs = "" if q == 0 else ("log n" if q == 1 else f"log^{q} n")
+    if abs(p) < 1e-9:
+        return f"O({logs or '1'})"
+    return f"O(n^{fmt_exp(p)}{' ' + logs if logs else ''})"
+
+def snap(x: float) -> float:
+    return float(round(x)) if abs(x - round(x)) < 1e-9 else x
+
+def crossing(h, lo: float, hi: float) -> float:
+    """Where the decreasing function h falls through 1 in [lo, hi], by bisection."""
+    for _ in range(200):
+        mid = (lo + hi) / 2
+        if h(mid) > 1:
+            lo = mid
+        else:
+            hi = mid
+    return snap((lo + hi) / 2)
+
+@functools.lru_cache(maxsize=1024)
+def solve_terms_key(key: tuple, f_expr: str):
+    """
+    solve_terms() for a normalized recurrence, memoized so a shape is solved once.
+    Returns (recurrence, solution, reasoning lines) or (None, error, None).
+    """
+    kind, k, _ = classify_f(f_expr)
+    growth = {"const": (0.0, 0), "log": (0.0, 1), "n": (1.0, 0), "nlogn": (1.0, 1)}.get(kind)
+    if kind == "nk":
+        growth = (float(k), 0)
+    if growth is None:
+        return None, f"Unsupported f(n): {f_expr}", None
+    f_pow, f_logs = growth
+
+    rec = f"T(n) = {fmt_calls(key)} + {f_expr}"
+    lines = [rec]
+    if key[0][2] == 0:
+        # Akra-Bazzi: sum a_i b_i^p = 1, then compare f(n) with n^p
+        def h(p):
+            return sum(a * (num / den) ** p for num, den, _, a in key)
+        hi = 1.0
+        while h(hi) > 1 and hi < 1024:
+            hi *= 2
+        p = crossing(h, 0.0, hi)
+        eq = " + ".join(f"{a if a != 1 else ''}({num}/{den})^p" for num, den, _, a in key)
+        lines.append(f"Akra-Bazzi: p = {p:.2f} solves {eq} = 1")
+        if f_pow < p - 1e-9:
+            sol = fmt_growth(p, 0)
+            lines.append("Case 1: f(n) = O(n^(p-ε)), so T(n) = Θ(n^p).")
+        elif abs(f_pow - p) <= 1e-9:
+            sol = fmt_growth(p, f_logs + 1)
+            lines.append("Case 2: f(n) = Θ(n^p log^q n), so T(n) = Θ(n^p log^(q+1) n).")
+        else:
+            sol = fmt_growth(f_pow, f_logs)
+            lines.append("Case 3: f(n) = Ω(n^(p+ε)), so T(n) = Θ(f(n)).")
+    else:
+        # linear: the characteristic root, sum a_i r^-c_i = 1, is > 1 and its r^n dominates f(n)
+        total = sum(a for _, _, _, a in key)
+        if total < 2:
+            return None, "A single T(n-c) term is the decrease model.", None
+        def h(r):
+            return sum(a * r ** (-c) for _, _, c, a in key)
+        r = crossing(h, 1.0, float(total))
+        eq = " + ".join(f"{a if a != 1 else ''}r^-{c}" for _, _, c, a in key)
+        sol = f"O({fmt_exp(r)}^n)"
+        lines.append(f"characteristic root r = {r:.2f} solves {eq} = 1")
+        lines.append("r > 1: the r^n solution of the homogeneous part dominates any polynomial f(n).")
+    return rec, sol, tuple(lines)
+
+def solve_terms(key: tuple, f_expr: str):
+    """
+    Solve T(n) = sum a_i T(b_i n) + f(n) by Akra-Bazzi, or T(n) = sum a_i T(n-c_i) + f(n)
+    by its characteristic root; key is from normalize_terms().
+    Returns dict with {recurrence, solution, case_reasoning} or {error: ...}
+    """
+    rec, sol, lines = solve_terms_key(key, f_expr)
+    if rec is None:
+        return {"error": sol}
+    return {"recurrence": rec, "solution": sol, "case_reasoning": list(lines)}
+
 # ==============================
 # Recurrence extraction & f(n) upgrade from callees
 # ==============================
@@ -171,6 +340,52 @@ def extract_recurrence(doc: dict):
 
     return None
 
+def extract_decrease(summary: dict):
+    """
+    Look for exactly one "decrease" recurrence {a, c, f} (no b), as leave_function() emits.
+    Return (a, c, f, src_label, func_name) or None.
+    """
+    def is_decrease(r):
+        return isinstance(r, dict) and r.get("model") == "decrease" and {"a", "c", "f"} <= r.keys() and "b" not in r
+
+    recs = [r for r in summary.get("recurrences", []) if isinstance(r, dict)]
+    if len(recs) == 1 and is_decrease(recs[0]):
+        r = recs[0]
+        return r["a"], r["c"], r["f"], "summary.recurrences[0]", r.get("function")
+
+    fn_matches = [(f.get("name"), f["recurrence"]) for f in summary.get("functions", [])
+                  if isinstance(f, dict) and is_decrease(f.get("recurrence"))]
+    if len(fn_matches) == 1:
+        name, r = fn_matches[0]
+        return r["a"], r["c"], r["f"], "summary.functions[*].recurrence", name
+
+    return None
+
+def extract_terms(summary: dict):
+    """
+    Look for exactly one recurrence whose "terms" need more than the Master Theorem or the
+    decrease model: several sizes, or a fraction num·n/den with num > 1.
+    Return (key, f, src_label, func_name) or None.
+    """
+    def beyond_single(r):
+        if not isinstance(r, dict) or not isinstance(r.get("f"), str):
+            return None
+        key = normalize_terms(r.get("terms"))
+        return key if key and (len(key) > 1 or key[0][0] > 1) else None
+
+    recs = [r for r in summary.get("recurrences", []) if isinstance(r, dict)]
+    if len(recs) == 1 and beyond_single(recs[0]):
+        r = recs[0]
+        return beyond_single(r), r["f"], "summary.recurrences[0]", r.get("function")
+
+    fn_matches = [(f.get("name"), f["recurrence"]) for f in summary.get("functions", [])
+                  if isinstance(f, dict) and beyond_single(f.get("recurrence"))]
+    if len(fn_matches) == 1:
+        name, r = fn_matches[0]
+        return beyond_single(r), r["f"], "summary.functions[*].recurrence", name
+
+    return None
+
 def pick_recursive_function_name(summary: dict) -> str | None:
     """Choose a recursive function if there is exactly one."""
     funcs = [f for f in summary.get("functions", []) if isinstance(f, dict)]
@@ -179,9 +394,10 @@ def pick_recursive_function_name(summary: dict) -> str | None:
         return rec[0]
     return None
 
-def infer_per_level_work(summary: dict, func_name: str) -> str | None:
+def infer_per_level_work(summary: dict, func_name: str, graph=None, costs=None) -> str | None:
     """
     Infer per-level non-recursive work for a recursive function from its non-recursive callees.
+    With the call graph, a callee counts with everything it calls in turn.
     Returns an f(n) expression string: "1", "n", or "n^k".
     """
     if not func_name:
@@ -200,6 +416,10 @@ def infer_per_level_work(summary: dict, func_name: str) -> str | None:
         if not G or G.get("is_recursive"):
             continue  # only consider non-recursive helpers
 
+        if graph and callee_name in graph[1]:
+            inferred_degree = max(inferred_degree, costs[graph[1][callee_name]][0])
+            continue
+
         depth = G.get("maxLoopDepth", 0) or 0
         loop_count = G.get("loopCount", 0) or 0
 
@@ -218,6 +438,21 @@ def infer_per_level_work(summary: dict, func_name: str) -> str | None:
         return "n"
     return f"n^{inferred_degree}"
 
+def per_level_f(summary: dict, func_name, f_expr: str, graph, costs):
+    """
+    f(n) for a recurrence of func_name (or the only recursive function), upgraded from its
+    non-recursive callees. Returns (f_expr, note), note None when nothing changed.
+    """
+    if not func_name:
+        func_name = pick_recursive_function_name(summary)
+    inferred_f = infer_per_level_work(summary, func_name, graph, costs) if func_name else None
+    if inferred_f:
+        new_f, upgraded = upgrade_f_if_weaker(f_expr, inferred_f)
+        if upgraded:
+            return new_f, (f"Adjusted f(n) from parser hint ({f_expr}) to inferred {new_f} "
+                           f"based on non-recursive callee loops (function: {func_name}).")
+    return f_expr, None
+
 def upgrade_f_if_weaker(provided_f: str, inferred_f: str) -> tuple[str, bool]:
     """
     If inferred_f is asymptotically stronger than provided_f, return inferred_f and True.
@@ -239,54 +474,267 @@ def upgrade_f_if_weaker(provided_f: str, inferred_f: str) -> tuple[str, bool]:
 # Loop baseline
 # ==============================
 
-def loop_baseline(summary: dict) -> tuple[str, list[str]]:
+def loop_factor(loop: dict) -> tuple[int, int]:
+    """Trip count of one loop as (power of n, power of log n); loops without a growth class are linear."""
+    growth = loop.get("growth")
+    bound = loop.get("bound")
+    if growth == "constant":
+        return (0, 0)
+    if growth == "log" or (growth == "dependent" and isinstance(bound, str) and bound.startswith("log ")):
+        return (0, 1)
+    return (1, 0)
+
+def sums_to_linear(outer: dict, inner: dict) -> bool:
+    """
+    An inner loop running up to the variable of a geometric outer loop
+    (i = 1, 2, 4, ..., n) takes 1 + 2 + 4 + ... + n = O(n) steps in all, not O(n log n).
+    """
+    var = outer.get("var")
+    bound = inner.get("bound")
+    return (outer.get("growth") == "log" and isinstance(var, str) and var != ""
+            and inner.get("growth") == "dependent" and inner.get("dependsOn") == var
+            and not (isinstance(bound, str) and bound.startswith("log ")))
+
+def loop_parents(loops: list) -> list[int]:
+    """Index of each loop's parent, the last loop before it one level shallower; -1 at the top."""
+    parents, open_ = [], []
+    for i, l in enumerate(loops):
+        depth = max(int(l.get("depth", 1) or 1), 1)
+        del open_[depth - 1:]
+        parents.append(open_[-1] if open_ else -1)
+        open_.append(i)
+    return parents
+
+def loop_cost(loops: list) -> tuple[int, int]:
+    """
+    Compose the per-loop trip counts over the nest as (power of n, power of log n).
+    Each loop costs its trip count times its costliest child, and the nest
+    the costliest top-level loop.
+    """
+    loops = [l for l in loops if isinstance(l, dict)]
+    parents = loop_parents(loops)
+    cost = [loop_factor(l) for l in loops]
+    best = (0, 0)
+    # children come after their parent, so walking backwards finishes them first
+    for i in reversed(range(len(loops))):
+        p = parents[i]
+        if p < 0:
+            best = max(best, cost[i])
+            continue
+        if sums_to_linear(loops[p], loops[i]):
+            pair = cost[i]
+        else:
+            f = loop_factor(loops[p])
+            pair = (f[0] + cost[i][0], f[1] + cost[i][1])
+        cost[p] = max(cost[p], pair)
+    return best
+
+def enclosed_cost(loops: list, parents: list[int], k: int, inner: tuple[int, int]) -> tuple[int, int]:
+    """Cost of doing `inner` once per iteration of loop k, inside the loops around it (k = -1: none)."""
+    child = -1
+    while k >= 0:
+        if child < 0 or not sums_to_linear(loops[k], loops[child]):
+            f = loop_factor(loops[k])
+            inner = (inner[0] + f[0], inner[1] + f[1])
+        child, k = k, parents[k]
+    return inner
+
+def fmt_cost(cost: tuple[int, int]) -> str:
+    """(2, 1) -> O(n^2 log n), (0, 2) -> O(log^2 n)"""
+    p, q = cost
+    logs = "log n" if q == 1 else f"log^{q} n"
+    if p == 0:
+        return f"O({logs})" if q else "O(1)"
+    return f"O(n^{p} {logs})" if q else f"O(n^{p})"
+
+def loop_baseline(summary: dict) -> tuple[str, list[str], tuple[int, int]]:
     """
-    Derive an O(n^d) headline from loop nesting depth as a baseline.
+    Derive an O(n^d) headline from loop nesting depth as a baseline. When the
+    parser classified the loops (constant, linear, log, dependent), their growth
+    classes are composed over the nest instead. Also returns the cost behind the headline.
     """
     loops = summary.get("loops", [])
     depth = max((int(l.get("depth", 1) or 1) for l in loops), default=0)
     headline = f"O(n^{depth})" if depth > 0 else "O(1)"
     expl = [f"Detected {len(loops)} loops; max depth = {depth}"]
-    return headline, expl
+    cost = (depth, 0)
+    if any(isinstance(l, dict) and "growth" in l for l in loops):
+        cost = loop_cost(loops)
+        if cost != (depth, 0):
+            headline = fmt_cost(cost)
+            expl.append(f"Loop bounds compose to {headline}")
+    return headline, expl, cost
+
+# ==============================
+# Call graph
+# ==============================
+
+def own_loops(f: dict) -> list:
+    loops = f.get("loops")
+    return [l for l in loops if isinstance(l, dict)] if isinstance(loops, list) else []
+
+def call_graph(summary: dict):
+    """
+    (functions, {name: index of the last function so named}, call sites) where
+    each function's sites are (callee index, index of the innermost enclosing
+    loop in its own loops or -1). Calls to functions not in the summary are
+    dropped. None for summaries without per-function loops.
+    """
+    fns = [f for f in summary.get("functions", []) if isinstance(f, dict) and isinstance(f.get("name"), str)]
+    if not any(isinstance(f.get("loops"), list) for f in fns):
+        return None
+    index = {f["name"]: i for i, f in enumerate(fns)}
+    edges = []
+    for f in fns:
+        nloops = len(own_loops(f))
+        sites = f.get("callSites")
+        out = []
+        for s in sites if isinstance(sites, list) else []:
+            if not isinstance(s, dict) or not isinstance(s.get("name"), str) or s["name"] not in index:
+                continue
+            loop = s.get("loop")
+            if not isinstance(loop, int) or isinstance(loop, bool) or not 0 <= loop < nloops:
+                loop = -1
+            out.append((index[s["name"]], loop))
+        edges.append(out)
+    return fns, index, edges
+
+def strongly_connected(edges: list) -> list[list[int]]:
+    """
+    Tarjan's strongly connected components, without recursion. Each comes out
+    after every component it calls into, i.e. callees first.
+    """
+    n = len(edges)
+    order, low, on_stack = [-1] * n, [0] * n, [False] * n
+    stack, sccs, counter = [], [], 0
+    for root in range(n):
+        if order[root] >= 0:
+            continue
+        work = [(root, 0)]
+        while work:
+            v, k = work[-1]
+            if k == 0:
+                order[v] = low[v] = counter
+                counter += 1
+                stack.append(v)
+                on_stack[v] = True
+            if k < len(edges[v]):
+                work[-1] = (v, k + 1)
+                w = edges[v][k][0]
+                if order[w] < 0:
+                    work.append((w, 0))
+                elif on_stack[w]:
+                    low[v] = min(low[v], order[w])
+                continue
+            work.pop()
+            if work:
+                u = work[-1][0]
+                low[u] = min(low[u], low[v])
+            if low[v] == order[v]:
+                comp = []
+                while True:
+                    w = stack.pop()
+                    on_stack[w] = False
+                    comp.append(w)
+                    if w == v:
+                        break
+                sccs.append(sorted(comp))
+    return sccs
+
+def function_costs(graph) -> tuple[list[tuple[int, int]], list[list[int]]]:
+    """
+    Cost of each function including everything it calls, as (power of n, power
+    of log n), and the strongly connected components. Components are costed
+    callees first, so every function is analyzed once and each caller reuses
+    the result. Calls inside a component (recursion, mutual recursion) add
+    nothing here; the recurrence solvers account for those.
+    """
+    fns, _, edges = graph
+    sccs = strongly_connected(edges)
+    comp = [0] * len(fns)
+    for c, members in enumerate(sccs):
+        for v in members:
+            comp[v] = c
+    cost = [(0, 0)] * len(fns)
+    for members in sccs:
+        for v in members:
+            loops = own_loops(fns[v])
+            parents = loop_parents(loops)
+            best = loop_cost(loops)
+            for w, loop in edges[v]:
+                if comp[w] != comp[v]:
+                    best = max(best, enclosed_cost(loops, parents, loop, cost[w]))
+            cost[v] = best
+    return cost, sccs
 
 # ==============================
 # HTTP API
 # ==============================
 
+def read_doc():
+    """Request body as a dict: MessagePack (as sent by parser-c) or JSON."""
+    if request.mimetype in MSGPACK_TYPES:
+        try:
+            return msgpack.unpackb(request.get_data(), raw=False)
+        except Exception:
+            return None
+    return request.get_json(silent=True)
+
+def reply(obj, status=200):
+    """Answer in MessagePack when the client asks for it, JSON otherwise."""
+    if request.accept_mimetypes.best_match(("application/json",) + MSGPACK_TYPES) in MSGPACK_TYPES:
+        return Response(msgpack.packb(obj, use_bin_type=True), status=status, mimetype="application/msgpack")
+    return jsonify(obj), status
+
 @app.route("/analyze", methods=["POST"])
 def analyze():
-    doc = request.get_json(silent=True)
+    doc = read_doc()
     if not isinstance(doc, dict) or "summary" not in doc:
-        return jsonify({"error": "invalid input"}), 400
+        return reply({"error": "invalid input"}, 400)
 
     summary = doc["summary"]
     functions = summary.get("functions", [])
     recursive_names = [f["name"] for f in functions if isinstance(f, dict) and f.get("is_recursive")]
-    headline, expl = loop_baseline(summary)
+    headline, expl, base_cost = loop_baseline(summary)
+    graph = call_graph(summary)
+    costs = None
+    if graph:
+        costs, sccs = function_costs(graph)
+        for members in sccs:
+            if len(members) > 1:
+                expl.append("mutually recursive: " + ", ".join(graph[0][v]["name"] for v in members))
+        top = max(range(len(costs)), key=lambda v: costs[v], default=-1)
+        if top >= 0 and costs[top] > base_cost:
+            headline = fmt_cost(costs[top])
+            expl.append(f"Call graph: {graph[0][top]['name']} costs {headline} with its callees")
     expl.append(("recursive functions present: " + ", ".join(recursive_names)) if recursive_names
                 else "no recursive functions detected")
 
-    # 1) Try to extract a recurrence.
-    rec = extract_recurrence(doc)
+    # 0) Several recursive calls, or a fraction that is not n/b: Akra-Bazzi or the characteristic root.
     recurrence_output = None
-    adjusted_note = None
-    rec_func_name = None
+    trec = extract_terms(summary)
+    if trec:
+        key, f_expr, src, rec_func_name = trec
+        f_expr, adjusted_note = per_level_f(summary, rec_func_name, f_expr, graph, costs)
+        solved = solve_terms(key, f_expr)
+        if "solution" in solved:
+            recurrence_output = solved
+            headline = solved["solution"]
+            how = "via Akra-Bazzi" if key[0][2] == 0 else "as a linear recurrence"
+            lead = f"Solved {how} (from {src}) {fmt_calls(key)}, f(n)={f_expr}"
+            if adjusted_note:
+                expl.insert(0, adjusted_note)
+            expl.insert(0, lead)
+
+    # 1) Try to extract a recurrence.
+    rec = extract_recurrence(doc) if not recurrence_output else None
 
     if rec:
         a, b, f_expr, src, rec_func_name = rec
 
         # 1a) Try to upgrade f(n) using non-recursive callees of the recursive function (if we know it).
         # If we don't know which function, but there is exactly one recursive function, use that.
-        if not rec_func_name:
-            rec_func_name = pick_recursive_function_name(summary)
-
-        inferred_f = infer_per_level_work(summary, rec_func_name) if rec_func_name else None
-        if inferred_f:
-            new_f, upgraded = upgrade_f_if_weaker(f_expr, inferred_f)
-            if upgraded:
-                adjusted_note = (f"Adjusted f(n) from parser hint ({f_expr}) to inferred {new_f} "
-                                 f"based on non-recursive callee loops (function: {rec_func_name}).")
-                f_expr = new_f
+        f_expr, adjusted_note = per_level_f(summary, rec_func_name, f_expr, graph, costs)
 
         # 1b) Solve via Master Theorem.
         recurrence_output = solve_master_theorem(a, b, f_expr)
@@ -297,6 +745,20 @@ def analyze():
                 expl.insert(0, adjusted_note)
             expl.insert(0, lead)
 
+    # 1c) No divide recurrence: try the decrease model T(n) = aT(n-c) + f(n).
+    drec = extract_decrease(summary) if not rec and not recurrence_output else None
+    if drec:
+        a, c, f_expr, src, rec_func_name = drec
+        f_expr, adjusted_note = per_level_f(summary, rec_func_name, f_expr, graph, costs)
+
+        recurrence_output = solve_decrease(a, c, f_expr)
+        if "solution" in recurrence_output:
+            headline = recurrence_output["solution"]
+            lead = f"Solved as a decrease recurrence (from {src}) a={a}, c={c}, f(n)={f_expr}"
+            if adjusted_note:
+                expl.insert(0, adjusted_note)
+            expl.insert(0, lead)
+
     # 2) If no solvable recurrence, tiny heuristic: recursion + no loops => linear.
     if not recurrence_output:
         has_recursive = bool(recursive_names)
@@ -313,4 +775,4 @@ def analyze():
     result = {"complexity": headline, "explanation": expl}
     if recurrence_output:
         result["recurrence_solution"] = recurrence_output
-    return jsonify(result)
+    return reply(result)
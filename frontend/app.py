@@ -1,10 +1,48 @@
-from flask import Flask, request, render_template
-import requests, json
+from flask import Flask, request, render_template, jsonify
+from concurrent.futures import ThreadPoolExecutor
+from urllib3.util.retry import Retry
+import requests, json, msgpack, os
 
 app = Flask(__name__)
 
-PARSER_URL = "http://parser-c:7001/parse"
-ANALYZER_URL = "http://analyzer:7100/analyze"
+PARSER_URL = os.environ.get("PARSER_URL", "http://parser-c:7001/parse")
+PARSER_BATCH_URL = os.environ.get("PARSER_BATCH_URL", PARSER_URL + "/batch")
+ANALYZER_URL = os.environ.get("ANALYZER_URL", "http://analyzer:7100/analyze")
+MSGPACK = "application/msgpack"
+
+# (connect, read) seconds for every backend call, so a hung service fails the request instead of the worker
+TIMEOUT = (float(os.environ.get("CONNECT_TIMEOUT", "1.0")), float(os.environ.get("READ_TIMEOUT", "10.0")))
+BATCH_MAX_ITEMS = int(os.environ.get("BATCH_MAX_ITEMS", "256"))
+
+# one pooled session so parser and analyzer calls reuse keep-alive connections;
+# parsing and analysis are pure functions of the input, so POSTs are safe to retry
+retry = Retry(total=int(os.environ.get("BACKEND_RETRIES", "2")), connect=2, read=1,
+              backoff_factor=0.2, status_forcelist=(502, 503, 504),
+              allowed_methods=frozenset(["GET", "POST"]), raise_on_status=False)
+http = requests.Session()
+http.mount("http://", requests.adapters.HTTPAdapter(pool_connections=4, pool_maxsize=32, max_retries=retry))
+
+# analyzer calls for batches run here while the parser is still streaming later items
+executor = ThreadPoolExecutor(max_workers=int(os.environ.get("BACKEND_WORKERS", "16")))
+
+def decode(resp):
+    """Body of a parser/analyzer response; both send errors as JSON."""
+    if resp.headers.get("Content-Type", "").startswith(MSGPACK):
+        return msgpack.unpackb(resp.content, raw=False)
+    return resp.json()
+
+def analyze_summary(summary):
+    resp = http.post(ANALYZER_URL, json={"summary": summary}, headers={"Accept": MSGPACK}, timeout=TIMEOUT)
+    return decode(resp)
+
+def analyze_item(parsed):
+    """Analysis of one /parse/batch result line, or its error."""
+    if "error" in parsed:
+        return {"error": parsed["error"]}
+    try:
+        return analyze_summary(parsed.get("summary", {}))
+    except Exception as e:
+        return {"error": f"contacting analyzer failed: {e}"}
 
 @app.route("/", methods=["GET", "POST"])
 def index():
@@ -15,17 +53,67 @@ def index():
     if request.method == "POST":
         code = request.form["code"]
         try:
-            # 1) Parser: get AST + summary (JSON)
-            parser_resp = requests.post(PARSER_URL, json={"language":"c","code":code})
-            parser_json = parser_resp.json()  # <- dict
+            # 1) Parser: get AST + summary (MessagePack), with the parser asking the analyzer itself
+            parser_resp = http.post(PARSER_URL, params={"analyze": "1"}, json={"language":"c","code":code},
+                                    headers={"Accept": MSGPACK}, timeout=TIMEOUT)
+            parser_json = decode(parser_resp)  # <- dict
             ast_output = parser_json.get("ast", {})
-            summary = parser_json.get("summary", {})
+            analysis_output = parser_json.get("analysis")
 
-            # 2) Analyzer: send summary (JSON) and get result
-            analyzer_resp = requests.post(ANALYZER_URL, json={"summary": summary})
-            analysis_output = analyzer_resp.json()  # <- dict
+            # 2) Analyzer: only when the parser could not reach it; forward the parser's
+            #    document as is (the analyzer reads "summary"), no re-encoding
+            if not isinstance(analysis_output, dict) or "error" in analysis_output:
+                if parser_resp.ok and parser_resp.headers.get("Content-Type", "").startswith(MSGPACK):
+                    analyzer_resp = http.post(ANALYZER_URL, data=parser_resp.content,
+                                              headers={"Content-Type": MSGPACK, "Accept": MSGPACK}, timeout=TIMEOUT)
+                    analysis_output = decode(analyzer_resp)  # <- dict
+                else:
+                    analysis_output = analyze_summary(parser_json.get("summary", {}))
 
         except Exception as e:
             analysis_output = {"error": f"contacting services failed: {e}"}
 
     return render_template("index.html", code=code, ast=ast_output, analysis=analysis_output)
+
+@app.route("/batch", methods=["POST"])
+def batch():
+    """
+    {"items": [{"id": ..., "code": "..."}, ...]} -> {"results": [{"id", "ast", "analysis"} | {"id", "error"}]}
+    The parser streams one NDJSON line per item as it finishes; each line is handed
+    to the analyzer on the executor right away, so item N is analyzed while item
+    N+1 is still being parsed. Results come back in input order.
+    """
+    doc = request.get_json(silent=True)
+    items = doc.get("items") if isinstance(doc, dict) else None
+    if not isinstance(items, list) or len(items) > BATCH_MAX_ITEMS:
+        return jsonify({"error": f"expected items: [{{id, code}}] (at most {BATCH_MAX_ITEMS})"}), 400
+
+    jobs = [{"id": i, "language": "c", "code": it.get("code", "") if isinstance(it, dict) else ""}
+            for i, it in enumerate(items)]
+    pending = {}  # index -> (parsed line, analysis future)
+    error = None
+    try:
+        with http.post(PARSER_BATCH_URL, json=jobs, stream=True, timeout=TIMEOUT,
+                       headers={"Accept": "application/x-ndjson"}) as resp:
+            if not resp.ok:
+                raise RuntimeError(f"parser answered {resp.status_code}")
+            for line in resp.iter_lines():
+                if not line:
+                    continue
+                parsed = json.loads(line)
+                pending[parsed["id"]] = (parsed, executor.submit(analyze_item, parsed))
+    except Exception as e:
+        error = f"contacting parser failed: {e}"
+
+    results = []
+    for i, it in enumerate(items):
+        item_id = it.get("id", i) if isinstance(it, dict) else i
+        if i not in pending:
+            results.append({"id": item_id, "error": error or "no result from parser"})
+            continue
+        parsed, future = pending[i]
+        if "error" in parsed:
+            results.append({"id": item_id, "error": parsed["error"]})
+        else:
+            results.append({"id": item_id, "ast": parsed.get("ast", {}), "analysis": future.result()})
+    return jsonify({"results": results})
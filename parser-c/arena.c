@@ -0,0 +1,228 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <tree_sitter/api.h>
+
+/* --------------------------- bump arena --------------------------- */
+
+#define ARENA_BLOCK_MIN (64 * 1024)
+#define ARENA_ALIGN     16
+
+struct arena_block {
+    arena_block *next;
+    size_t       cap;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+static size_t align_up(size_t n) { return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1); }
+
+void arena_init(arena *A) { A->head = NULL; A->used = 0; }
+
+void arena_reset(arena *A) {
+    if (!A->head) return;
+    A->used = 0;
+    if (!A->head->next) return;
+    // the request outgrew one block: coalesce into a single block that would
+    // have held all of it, so the next request of that size bumps only
+    size_t total = 0;
+    for (arena_block *b = A->head; b; b = b->next) total += b->cap;
+    arena_free(A);
+    arena_block *b = (arena_block*)malloc(sizeof(arena_block) + total);
+    if (!b) return;
+    b->cap = total;
+    b->next = NULL;
+    A->head = b;
+}
+
+void arena_free(arena *A) {
+    arena_block *b = A->head;
+    while (b) {
+        arena_block *n = b->next;
+        free(b);
+        b = n;
+    }
+    arena_init(A);
+}
+
+void *arena_alloc(arena *A, size_t n) {
+    n = align_up(n ? n : 1);
+    if (!A->head || A->used + n > A->head->cap) {
+        size_t cap = n > ARENA_BLOCK_MIN ? n : ARENA_BLOCK_MIN;
+        arena_block *b = (arena_block*)malloc(sizeof(arena_block) + cap);
+        if (!b) return NULL;
+        b->cap = cap;
+        b->next = A->head;
+        A->head = b;
+        A->used = 0;
+    }
+    void *p = A->head->data + A->used;
+    A->used += n;
+    return p;
+}
+
+char *arena_strndup(arena *A, const char *s, size_t n) {
+    char *out = (char*)arena_alloc(A, n + 1);
+    if (!out) return NULL;
+    if (n) memcpy(out, s, n);
+    out[n] = '\0';
+    return out;
+}
+
+void *arena_grow(arena *A, void *p, size_t old_n, size_t new_n) {
+    if (!p) return arena_alloc(A, new_n);
+    if (new_n <= old_n) return p;
+    size_t old_a = align_up(old_n ? old_n : 1), new_a = align_up(new_n);
+    if (A->head && (unsigned char*)p == A->head->data + A->used - old_a &&
+        A->used - old_a + new_a <= A->head->cap) {
+        A->used += new_a - old_a;  // newest allocation: extend it in place
+        return p;
+    }
+    void *q = arena_alloc(A, new_n);
+    if (q) memcpy(q, p, old_n);
+    return q;
+}
+
+static pthread_key_t  ARENA_KEY;
+static pthread_once_t ARENA_ONCE = PTHREAD_ONCE_INIT;
+
+static void arena_key_free(void *p) {
+    arena_free((arena*)p);
+    free(p);
+}
+
+static void arena_key_init(void) { pthread_key_create(&ARENA_KEY, arena_key_free); }
+
+arena *arena_thread(void) {
+    pthread_once(&ARENA_ONCE, arena_key_init);
+    arena *A = (arena*)pthread_getspecific(ARENA_KEY);
+    if (!A) {
+        A = (arena*)malloc(sizeof(arena));
+        if (!A) return NULL;
+        arena_init(A);
+        pthread_setspecific(ARENA_KEY, A);
+    }
+    return A;
+}
+
+/* --------------------------- tree-sitter pool ---------------------------
+   Power-of-two size classes from 32 bytes to 16 KiB; anything larger goes
+   straight to malloc. Every block carries a small header with its class,
+   so ts_pool_free() works no matter which thread allocated the block and
+   realloc within the same class is free. Each thread caches at most
+   POOL_THREAD_MAX bytes of free blocks.
+*/
+
+#define POOL_CLASSES    10          // 32 << 0 .. 32 << 9
+#define POOL_MIN_SHIFT  5
+#define POOL_LARGE      0xffu
+#define POOL_THREAD_MAX (8u << 20)  // 8 MiB
+
+typedef struct {
+    uint32_t cls;
+    uint32_t pad;
+    size_t   size;                  // usable bytes
+} pool_header;
+
+typedef union pool_hdr_aligned {
+    pool_header h;
+    _Alignas(ARENA_ALIGN) unsigned char raw[ARENA_ALIGN];
+} pool_hdr_aligned;
+
+typedef struct pool_free_block { struct pool_free_block *next; } pool_free_block;
+
+typedef struct {
+    pool_free_block *free[POOL_CLASSES];
+    size_t cached;                  // bytes sitting in the free lists
+    bool   dead;                    // thread is exiting: bypass the cache
+} pool_cache;
+
+static bool           POOL_ON = false;
+static pthread_key_t  POOL_KEY;
+static pthread_once_t POOL_ONCE = PTHREAD_ONCE_INIT;
+static __thread pool_cache POOL_TLS;
+
+static void pool_thread_exit(void *p) {
+    pool_cache *pc = (pool_cache*)p;
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        pool_free_block *b = pc->free[c];
+        while (b) {
+            pool_free_block *n = b->next;
+            free((pool_hdr_aligned*)b - 1);
+            b = n;
+        }
+        pc->free[c] = NULL;
+    }
+    pc->cached = 0;
+    pc->dead = true;  // frees from later destructors (e.g. the thread's parser) go to libc
+}
+
+static void pool_key_init(void) { pthread_key_create(&POOL_KEY, pool_thread_exit); }
+
+static pool_cache *pool_cache_get(void) {
+    pool_cache *pc = &POOL_TLS;
+    if (pc->dead) return NULL;
+    if (!pthread_getspecific(POOL_KEY)) pthread_setspecific(POOL_KEY, pc);
+    return pc;
+}
+
+static int pool_class(size_t n) {
+    size_t sz = (size_t)1 << POOL_MIN_SHIFT;
+    for (int c = 0; c < POOL_CLASSES; c++, sz <<= 1) if (n <= sz) return c;
+    return -1;
+}
+
+static void *pool_malloc(size_t n) {
+    int c = pool_class(n);
+    pool_cache *pc = c >= 0 ? pool_cache_get() : NULL;
+    size_t size = c >= 0 ? ((size_t)1 << (POOL_MIN_SHIFT + c)) : n;
+    if (pc && pc->free[c]) {
+        pool_free_block *b = pc->free[c];
+        pc->free[c] = b->next;
+        pc->cached -= size;
+        return b;
+    }
+    pool_hdr_aligned *h = (pool_hdr_aligned*)malloc(sizeof(pool_hdr_aligned) + size);
+    if (!h) return NULL;
+    h->h.cls = c >= 0 ? (uint32_t)c : POOL_LARGE;
+    h->h.size = size;
+    return h + 1;
+}
+
+void ts_pool_free(void *p) {
+    if (!p) return;
+    if (!POOL_ON) { free(p); return; }
+    pool_hdr_aligned *h = (pool_hdr_aligned*)p - 1;
+    pool_cache *pc = h->h.cls != POOL_LARGE ? pool_cache_get() : NULL;
+    if (!pc || pc->cached + h->h.size > POOL_THREAD_MAX) { free(h); return; }
+    pool_free_block *b = (pool_free_block*)p;
+    b->next = pc->free[h->h.cls];
+    pc->free[h->h.cls] = b;
+    pc->cached += h->h.size;
+}
+
+static void *pool_calloc(size_t count, size_t n) {
+    if (n && count > SIZE_MAX / n) return NULL;
+    void *p = pool_malloc(count * n);
+    if (p) memset(p, 0, count * n);
+    return p;
+}
+
+static void *pool_realloc(void *p, size_t n) {
+    if (!p) return pool_malloc(n);
+    pool_hdr_aligned *h = (pool_hdr_aligned*)p - 1;
+    if (n <= h->h.size) return p;
+    void *q = pool_malloc(n);
+    if (!q) return NULL;
+    memcpy(q, p, h->h.size);
+    ts_pool_free(p);
+    return q;
+}
+
+void ts_pool_install(void) {
+    pthread_once(&POOL_ONCE, pool_key_init);
+    POOL_ON = true;
+    ts_set_allocator(pool_malloc, pool_calloc, pool_realloc, ts_pool_free);
+}
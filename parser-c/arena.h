@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bump allocator for short-lived request state. Allocations are never
+   freed one by one; arena_reset() drops them all at once and keeps the
+   first block, so an arena reused for every request on a thread settles
+   at zero mallocs per request. */
+
+typedef struct arena_block arena_block;
+
+typedef struct {
+    arena_block *head;    // block currently bumped into; older blocks follow
+    size_t       used;    // bytes taken from head
+} arena;
+
+void  arena_init(arena *A);
+void  arena_reset(arena *A);
+void  arena_free(arena *A);
+
+void *arena_alloc(arena *A, size_t n);                       // 16-byte aligned, NULL on OOM
+char *arena_strndup(arena *A, const char *s, size_t n);      // NUL-terminated copy
+// grow an arena array in place when it is the newest allocation, else copy
+void *arena_grow(arena *A, void *p, size_t old_n, size_t new_n);
+
+// thread-local arena, reset by whoever owns the current request
+arena *arena_thread(void);
+
+/* Size-class pool behind tree-sitter's allocator hooks. Freed blocks go
+   to a per-thread free list and are handed out again to the next parse
+   on that thread; a block may be freed on any thread. Call before the
+   first parser is created. */
+void  ts_pool_install(void);
+void  ts_pool_free(void *p);   // free for memory tree-sitter returned (e.g. changed ranges)
+
+#endif
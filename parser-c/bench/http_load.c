@@ -0,0 +1,305 @@
+/* http_load: closed-loop load generator for POST /parse.
+
+     http_load [--host 127.0.0.1] [--port 7001] [--path /parse] [--duration 5]
+               [--concurrency 1,2,4,8,16,32] [--no-cache-bust] [file.c]
+
+   For each concurrency level, that many threads each keep one keep-alive
+   connection and send the next request as soon as the previous answer is
+   in, for --duration seconds. Every request appends a unique comment to
+   the source so the parser's result cache does not answer it (unless
+   --no-cache-bust). Reported per level: requests, errors, requests/s and
+   latency p50/p90/p99/max in milliseconds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+static const char DEFAULT_SOURCE[] =
+    "void matmul(const int *A, const int *B, int *C, int n) {\n"
+    "    for (int i = 0; i < n; ++i)\n"
+    "        for (int j = 0; j < n; ++j) {\n"
+    "            long long s = 0;\n"
+    "            for (int k = 0; k < n; ++k) s += (long long)A[i*n + k] * B[k*n + j];\n"
+    "            C[i*n + j] = (int)s;\n"
+    "        }\n"
+    "}\n\n"
+    "int bsearch_rec(const int *a, int l, int r, int key) {\n"
+    "    if (l > r) return -1;\n"
+    "    int m = l + (r - l) / 2;\n"
+    "    if (a[m] == key) return m;\n"
+    "    if (a[m] > key) return bsearch_rec(a, l, m-1, key);\n"
+    "    return bsearch_rec(a, m+1, r, key);\n"
+    "}\n";
+
+static struct {
+    const char *host, *port, *path;
+    double duration_s;
+    bool cache_bust;
+    char *code_json;      // the source as a JSON string body, without the closing quote
+    size_t code_json_len;
+} CFG = { "127.0.0.1", "7001", "/parse", 5.0, true, NULL, 0 };
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// {"language":"c","code":"<escaped source>   (closed per request)
+static void build_body_prefix(const char *src, size_t len) {
+    static const char head[] = "{\"language\":\"c\",\"code\":\"";
+    char *out = (char*)malloc(sizeof(head) + len * 6);
+    if (!out) abort();
+    size_t o = sizeof(head) - 1;
+    memcpy(out, head, o);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)src[i];
+        if (c == '"' || c == '\\') { out[o++] = '\\'; out[o++] = (char)c; }
+        else if (c == '\n') { out[o++] = '\\'; out[o++] = 'n'; }
+        else if (c == '\t') { out[o++] = '\\'; out[o++] = 't'; }
+        else if (c < 0x20) o += (size_t)sprintf(out + o, "\\u%04x", c);
+        else out[o++] = (char)c;
+    }
+    CFG.code_json = out;
+    CFG.code_json_len = o;
+}
+
+/* --------------------------- one connection --------------------------- */
+
+static int dial(void) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res = NULL;
+    if (getaddrinfo(CFG.host, CFG.port, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) { close(fd); fd = -1; }
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return -1;
+        p += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} rbuf;
+
+/* Read one response; returns its status (0 on failure) and sets *keep.
+   Bytes past the response stay in b for the next call. */
+static int read_response(int fd, rbuf *b, bool *keep) {
+    *keep = false;
+    size_t head_end = 0, scanned = 0;
+    for (;;) {
+        for (size_t i = scanned; i + 4 <= b->len && !head_end; i++) {
+            if (memcmp(b->buf + i, "\r\n\r\n", 4) == 0) head_end = i + 4;
+        }
+        if (head_end) break;
+        scanned = b->len >= 3 ? b->len - 3 : 0;
+        if (b->len == b->cap) {
+            b->cap = b->cap ? b->cap * 2 : 65536;
+            b->buf = (char*)realloc(b->buf, b->cap);
+            if (!b->buf) abort();
+        }
+        ssize_t k = recv(fd, b->buf + b->len, b->cap - b->len, 0);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return 0;
+        b->len += (size_t)k;
+    }
+
+    int status = 0;
+    if (sscanf(b->buf, "HTTP/1.%*d %d", &status) != 1) return 0;
+    size_t body_len = 0;
+    *keep = true;
+    for (char *line = strstr(b->buf, "\r\n") + 2; line < b->buf + head_end - 2; line = strstr(line, "\r\n") + 2) {
+        if (strncasecmp(line, "Content-Length:", 15) == 0) body_len = strtoull(line + 15, NULL, 10);
+        else if (strncasecmp(line, "Connection: close", 17) == 0) *keep = false;
+    }
+
+    size_t total = head_end + body_len;
+    if (total > b->cap) {
+        b->cap = total;
+        b->buf = (char*)realloc(b->buf, b->cap);
+        if (!b->buf) abort();
+    }
+    while (b->len < total) {
+        ssize_t k = recv(fd, b->buf + b->len, b->cap - b->len, 0);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return 0;
+        b->len += (size_t)k;
+    }
+    memmove(b->buf, b->buf + total, b->len - total);
+    b->len -= total;
+    return status;
+}
+
+/* --------------------------- workers --------------------------- */
+
+typedef struct {
+    int id;
+    uint64_t deadline_ns;
+    uint64_t *lat;        // latency of every successful request, ns
+    size_t nlat, caplat;
+    size_t errors;
+} worker;
+
+static void *worker_main(void *arg) {
+    worker *W = (worker*)arg;
+    // the header's fixed text, --path/--host/--port and Content-Length, then the body and its tail
+    size_t head_cap = strlen(CFG.path) + strlen(CFG.host) + strlen(CFG.port) + 128;
+    size_t cap = head_cap + CFG.code_json_len + 96;
+    char *req = (char*)malloc(cap);
+    if (!req) abort();
+    rbuf b = {0};
+    int fd = -1;
+    for (uint64_t seq = 0; now_ns() < W->deadline_ns; seq++) {
+        char tail[96];
+        int tn = CFG.cache_bust ? snprintf(tail, sizeof(tail), "\\n// load %d %llu\"}", W->id, (unsigned long long)seq)
+                                : snprintf(tail, sizeof(tail), "\"}");
+        size_t body_len = CFG.code_json_len + (size_t)tn;
+        int hn = snprintf(req, cap, "POST %s HTTP/1.1\r\nHost: %s:%s\r\nContent-Type: application/json\r\n"
+                                    "Content-Length: %zu\r\n\r\n", CFG.path, CFG.host, CFG.port, body_len);
+        if (hn < 0 || (size_t)hn >= head_cap) abort();  // head_cap is sized for it
+        memcpy(req + hn, CFG.code_json, CFG.code_json_len);
+        memcpy(req + hn + CFG.code_json_len, tail, (size_t)tn);
+
+        if (fd < 0 && (fd = dial()) < 0) { W->errors++; usleep(1000); continue; }
+        uint64_t t0 = now_ns();
+        bool keep = false;
+        int status = send_all(fd, req, (size_t)hn + body_len) == 0 ? read_response(fd, &b, &keep) : 0;
+        uint64_t dt = now_ns() - t0;
+        if (status == 200) {
+            if (W->nlat == W->caplat) {
+                W->caplat = W->caplat ? W->caplat * 2 : 4096;
+                W->lat = (uint64_t*)realloc(W->lat, W->caplat * sizeof(uint64_t));
+                if (!W->lat) abort();
+            }
+            W->lat[W->nlat++] = dt;
+        } else {
+            W->errors++;
+        }
+        if (!status || !keep) { close(fd); fd = -1; b.len = 0; }
+    }
+    if (fd >= 0) close(fd);
+    free(b.buf);
+    free(req);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct_ms(const uint64_t *v, size_t n, double p) {
+    if (n == 0) return 0.0;
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return (double)v[i] / 1e6;
+}
+
+static void run_level(int conc) {
+    worker *ws = (worker*)calloc((size_t)conc, sizeof(worker));
+    pthread_t *ts = (pthread_t*)calloc((size_t)conc, sizeof(pthread_t));
+    if (!ws || !ts) abort();
+    uint64_t start = now_ns(), deadline = start + (uint64_t)(CFG.duration_s * 1e9);
+    for (int i = 0; i < conc; i++) {
+        ws[i].id = i;
+        ws[i].deadline_ns = deadline;
+        if (pthread_create(&ts[i], NULL, worker_main, &ws[i]) != 0) { perror("pthread_create"); exit(1); }
+    }
+    size_t n = 0, errors = 0;
+    for (int i = 0; i < conc; i++) {
+        pthread_join(ts[i], NULL);
+        n += ws[i].nlat;
+        errors += ws[i].errors;
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    uint64_t *all = (uint64_t*)malloc((n ? n : 1) * sizeof(uint64_t));
+    if (!all) abort();
+    size_t k = 0;
+    for (int i = 0; i < conc; i++) {
+        memcpy(all + k, ws[i].lat, ws[i].nlat * sizeof(uint64_t));
+        k += ws[i].nlat;
+        free(ws[i].lat);
+    }
+    qsort(all, n, sizeof(uint64_t), cmp_u64);
+    printf("%6d %9zu %7zu %10.1f %9.3f %9.3f %9.3f %9.3f\n", conc, n, errors, (double)n / elapsed,
+           pct_ms(all, n, 0.50), pct_ms(all, n, 0.90), pct_ms(all, n, 0.99), n ? (double)all[n - 1] / 1e6 : 0.0);
+    fflush(stdout);
+    free(all);
+    free(ws);
+    free(ts);
+}
+
+int main(int argc, char **argv) {
+    int levels[32] = { 1, 2, 4, 8, 16, 32 };
+    int nlevels = 6;
+    const char *file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) CFG.host = argv[++i];
+        else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) CFG.port = argv[++i];
+        else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) CFG.path = argv[++i];
+        else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) CFG.duration_s = atof(argv[++i]);
+        else if (strcmp(argv[i], "--no-cache-bust") == 0) CFG.cache_bust = false;
+        else if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            nlevels = 0;
+            for (char *p = argv[++i]; *p && nlevels < 32; ) {
+                int c = (int)strtol(p, &p, 10);
+                if (c > 0) levels[nlevels++] = c;
+                if (*p == ',') p++;
+                else break;
+            }
+        } else if (argv[i][0] != '-' && !file) file = argv[i];
+        else {
+            fprintf(stderr, "usage: %s [--host H] [--port P] [--path /parse] [--duration S] "
+                            "[--concurrency 1,2,4,...] [--no-cache-bust] [file.c]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (file) {
+        FILE *f = fopen(file, "rb");
+        if (!f) { perror(file); return 1; }
+        fseek(f, 0, SEEK_END);
+        long len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        char *src = (char*)malloc(len > 0 ? (size_t)len : 1);
+        if (!src || fread(src, 1, (size_t)len, f) != (size_t)len) { fclose(f); fprintf(stderr, "cannot read %s\n", file); return 1; }
+        fclose(f);
+        build_body_prefix(src, (size_t)len);
+        free(src);
+    } else {
+        build_body_prefix(DEFAULT_SOURCE, sizeof(DEFAULT_SOURCE) - 1);
+    }
+
+    printf("%6s %9s %7s %10s %9s %9s %9s %9s\n", "conc", "requests", "errors", "req/s", "p50_ms", "p90_ms", "p99_ms", "max_ms");
+    for (int i = 0; i < nlevels; i++) run_level(levels[i]);
+    free(CFG.code_json);
+    return 0;
+}
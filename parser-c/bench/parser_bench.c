@@ -0,0 +1,295 @@
+/* parser_bench: parse_code() in-process over generated sources and files.
+
+     parser_bench [--profile loops|recursion|calls|mixed] [--lines 50,500,5000,50000]
+                  [--min-time-ms 500] [--threads N] [--ts-pool] [--msgpack] [file.c ...]
+
+   Every case is parsed once to warm up, then repeatedly until --min-time-ms
+   has passed (at least 3 times). Reported per case: ns/op, MB/s of
+   source, allocations and allocated bytes per op, and the process's peak
+   RSS so far. Allocations are counted by wrapping malloc/calloc/realloc
+   and free at link time (see CMakeLists.txt), which covers parse.c, json.c
+   and the statically linked tree-sitter runtime; bytes still live after
+   the timed ops are reported as leak_B/op and should be 0. --msgpack
+   encodes as for an Accept: application/msgpack client and takes the
+   buffer the way /parse does. */
+
+#include "parse.h"
+#include "arena.h"
+#include "workpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+/* --------------------------- allocation counting --------------------------- */
+
+static atomic_ullong ALLOCS, ALLOC_BYTES;
+static atomic_llong LIVE_BYTES;  // usable size of every block not yet freed
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void __real_free(void *p);
+
+static void *counted(void *p) {
+    atomic_fetch_add_explicit(&LIVE_BYTES, (long long)malloc_usable_size(p), memory_order_relaxed);
+    return p;
+}
+
+void *__wrap_malloc(size_t n) {
+    atomic_fetch_add_explicit(&ALLOCS, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ALLOC_BYTES, n, memory_order_relaxed);
+    return counted(__real_malloc(n));
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    atomic_fetch_add_explicit(&ALLOCS, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ALLOC_BYTES, n * size, memory_order_relaxed);
+    return counted(__real_calloc(n, size));
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+    atomic_fetch_add_explicit(&ALLOCS, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ALLOC_BYTES, n, memory_order_relaxed);
+    size_t old = malloc_usable_size(p);
+    void *q = __real_realloc(p, n);
+    if (!q && n) return NULL;  // p is untouched
+    atomic_fetch_sub_explicit(&LIVE_BYTES, (long long)old, memory_order_relaxed);
+    return counted(q);
+}
+
+void __wrap_free(void *p) {
+    atomic_fetch_sub_explicit(&LIVE_BYTES, (long long)malloc_usable_size(p), memory_order_relaxed);
+    __real_free(p);
+}
+
+/* --------------------------- generated sources --------------------------- */
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    size_t lines;
+} sbuf;
+
+static void put(sbuf *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void put(sbuf *s, const char *fmt, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(s->buf ? s->buf + s->len : NULL, s->cap - s->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) abort();
+        if ((size_t)n < s->cap - s->len) {
+            for (const char *p = s->buf + s->len; *p; p++) s->lines += *p == '\n';
+            s->len += (size_t)n;
+            return;
+        }
+        size_t ncap = s->cap ? s->cap * 2 : 65536;
+        while (ncap - s->len <= (size_t)n) ncap *= 2;
+        char *p = (char*)realloc(s->buf, ncap);
+        if (!p) abort();
+        s->buf = p;
+        s->cap = ncap;
+    }
+}
+
+// nested loops, depth cycling 1..3
+static void gen_loops(sbuf *s, int id) {
+    int depth = 1 + id % 3;
+    put(s, "int loops_%d(const int *a, int n) {\n    long s = 0;\n", id);
+    for (int d = 0; d < depth; d++) put(s, "%*sfor (int i%d = 0; i%d < n; ++i%d)\n", 4 + 4 * d, "", d, d, d);
+    put(s, "%*ss += a[i0] * %d;\n    return (int)s;\n}\n\n", 4 + 4 * depth, "", id);
+}
+
+// a divide-and-conquer function (mergesort shape) or a decrease one (factorial shape)
+static void gen_recursion(sbuf *s, int id) {
+    if (id % 2 == 0) {
+        put(s, "int divide_%d(int *a, int l, int r) {\n"
+               "    if (r - l < 2) return a[l];\n"
+               "    int m = l + (r - l) / 2;\n"
+               "    int x = divide_%d(a, l, m) + divide_%d(a, m, r);\n"
+               "    for (int k = l; k < r; ++k) x += a[k];\n"
+               "    return x;\n}\n\n", id, id, id);
+    } else {
+        put(s, "long decrease_%d(long n) {\n"
+               "    if (n <= 1) return 1;\n"
+               "    return n * decrease_%d(n - 1);\n}\n\n", id, id);
+    }
+}
+
+// call density: each function calls up to 4 earlier ones
+static void gen_calls(sbuf *s, int id) {
+    put(s, "int calls_%d(int x) {\n    int y = x + %d;\n", id, id);
+    for (int k = 1; k <= 4 && id - k >= 0; k++) put(s, "    y += calls_%d(y) - printf(\"%%d\", y);\n", id - k);
+    put(s, "    return y;\n}\n\n");
+}
+
+typedef void (*gen_fn)(sbuf *s, int id);
+
+static char *generate(const char *profile, size_t lines, size_t *len) {
+    static const gen_fn mixed[] = { gen_loops, gen_recursion, gen_calls };
+    sbuf s = {0};
+    put(&s, "#include <stdio.h>\n\n");
+    for (int id = 0; s.lines < lines; id++) {
+        if (strcmp(profile, "loops") == 0) gen_loops(&s, id);
+        else if (strcmp(profile, "recursion") == 0) gen_recursion(&s, id);
+        else if (strcmp(profile, "calls") == 0) gen_calls(&s, id);
+        else mixed[id % 3](&s, id / 3);
+    }
+    *len = s.len;
+    return s.buf;
+}
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    sbuf s = {0};
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        if (s.len + n + 1 > s.cap) {
+            s.cap = (s.len + n + 1) * 2;
+            s.buf = (char*)realloc(s.buf, s.cap);
+            if (!s.buf) abort();
+        }
+        memcpy(s.buf + s.len, chunk, n);
+        s.len += n;
+    }
+    fclose(f);
+    if (!s.buf) s.buf = (char*)calloc(1, 1);
+    s.buf[s.len] = '\0';
+    *len = s.len;
+    return s.buf;
+}
+
+/* --------------------------- measurement --------------------------- */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : -1;
+}
+
+static jw_format FORMAT = JW_JSON;
+
+// one op: what POST /parse does for a cache miss
+static bool parse_once(const char *code, size_t len) {
+    json_writer w;
+    jw_init_format(&w, FORMAT);
+    jw_object_begin(&w);
+    parse_result r = parse_code_n("c", code, len, NULL, &w);
+    jw_object_end(&w);
+    if (r.error) {
+        jw_free(&w);
+        return false;
+    }
+    size_t n;
+    char *payload = jw_take(&w, &n);  // and w is dropped, as in parse_payload
+    free(payload);
+    return payload != NULL;
+}
+
+static void bench_case(const char *name, const char *code, size_t len, uint64_t min_ns) {
+    size_t lines = 0;
+    for (size_t i = 0; i < len; i++) lines += code[i] == '\n';
+    if (!parse_once(code, len)) {
+        printf("%-28s parse failed\n", name);
+        return;
+    }
+    unsigned long long a0 = atomic_load(&ALLOCS), b0 = atomic_load(&ALLOC_BYTES);
+    long long live0 = atomic_load(&LIVE_BYTES);
+    uint64_t t0 = now_ns(), elapsed = 0;
+    size_t iters = 0;
+    while (iters < 3 || elapsed < min_ns) {
+        parse_once(code, len);
+        iters++;
+        elapsed = now_ns() - t0;
+    }
+    double ns_op = (double)elapsed / (double)iters;
+    printf("%-28s %7zu %9zu %7zu %13.0f %8.1f %11.1f %13.0f %10.1f %10ld\n", name, lines, len, iters, ns_op,
+           (double)len / ns_op * 1e3,
+           (double)(atomic_load(&ALLOCS) - a0) / (double)iters,
+           (double)(atomic_load(&ALLOC_BYTES) - b0) / (double)iters,
+           (double)(atomic_load(&LIVE_BYTES) - live0) / (double)iters, peak_rss_kb());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    const char *profiles[] = { "loops", "recursion", "calls", "mixed" };
+    size_t nprofiles = 4;
+    size_t sizes[16] = { 50, 500, 5000, 50000 };
+    size_t nsizes = 4;
+    uint64_t min_ns = 500ull * 1000000u;
+    int threads = 0;
+    int first_file = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profiles[0] = argv[++i];
+            nprofiles = 1;
+        } else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            nsizes = 0;
+            for (char *p = argv[++i]; *p && nsizes < 16; ) {
+                sizes[nsizes++] = strtoull(p, &p, 10);
+                if (*p == ',') p++;
+                else break;
+            }
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc) {
+            min_ns = strtoull(argv[++i], NULL, 10) * 1000000u;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ts-pool") == 0) {
+            ts_pool_install();
+        } else if (strcmp(argv[i], "--msgpack") == 0) {
+            FORMAT = JW_MSGPACK;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--profile loops|recursion|calls|mixed] [--lines a,b,...] "
+                            "[--min-time-ms N] [--threads N] [--ts-pool] [--msgpack] [file.c ...]\n", argv[0]);
+            return 2;
+        } else {
+            first_file = i;
+            break;
+        }
+    }
+    parse_set_timeout_micros(0);
+    if (threads > 0 && workpool_start((size_t)threads) == 0) parse_set_parallel_min_bytes(64 << 10);
+
+    printf("%-28s %7s %9s %7s %13s %8s %11s %13s %10s %10s\n",
+           "case", "lines", "bytes", "iters", "ns/op", "MB/s", "allocs/op", "alloc_B/op", "leak_B/op", "rss_kb");
+#ifdef BENCH_SAMPLE
+    if (first_file == argc) {
+        size_t len;
+        char *code = read_file(BENCH_SAMPLE, &len);
+        if (code) bench_case("sample", code, len, min_ns);
+        free(code);
+    }
+#endif
+    for (int i = first_file; i < argc; i++) {
+        size_t len;
+        char *code = read_file(argv[i], &len);
+        if (!code) { fprintf(stderr, "cannot read %s\n", argv[i]); return 1; }
+        bench_case(argv[i], code, len, min_ns);
+        free(code);
+    }
+    for (size_t p = 0; p < nprofiles; p++) {
+        for (size_t s = 0; s < nsizes; s++) {
+            size_t len;
+            char *code = generate(profiles[p], sizes[s], &len);
+            char name[64];
+            snprintf(name, sizeof(name), "%s/%zu", profiles[p], sizes[s]);
+            bench_case(name, code, len, min_ns);
+            free(code);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include "cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct cache_entry {
+    uint64_t hash;
+    struct cache_entry *chain;        // next in bucket
+    struct cache_entry *prev, *next;  // LRU list, most recent at head
+    size_t lang_len;
+    size_t code_len;
+    size_t payload_len;
+    char  *payload;
+    char   key[];                     // language '\0' code
+} cache_entry;
+
+static struct {
+    pthread_mutex_t mu;
+    cache_entry **buckets;
+    size_t nbuckets;                  // power of two
+    cache_entry *head, *tail;
+    size_t max_entry;
+    cache_stats st;
+} C = { .mu = PTHREAD_MUTEX_INITIALIZER };
+
+/* --------------------------- hashing ---------------------------
+   64-bit multiply/xor-shift mix over 8-byte words; the language is hashed
+   first and acts as the seed for the code. */
+
+static inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hash_bytes(const char *p, size_t n, uint64_t seed) {
+    const uint64_t m = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = seed ^ (n * m);
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ mix64(w)) * m;
+        p += 8; n -= 8;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, n);
+    h = (h ^ mix64(tail)) * m;
+    return mix64(h);
+}
+
+uint64_t cache_hash(const char *language, const char *code, size_t code_len) {
+    uint64_t seed = hash_bytes(language, strlen(language), 0x2545f4914f6cdd1dULL);
+    return hash_bytes(code, code_len, seed);
+}
+
+/* --------------------------- table + LRU --------------------------- */
+
+void cache_init(size_t capacity_bytes, size_t max_entry_bytes) {
+    pthread_mutex_lock(&C.mu);
+    C.st.capacity = capacity_bytes;
+    C.max_entry = max_entry_bytes;
+    if (capacity_bytes > 0 && !C.buckets) {
+        C.nbuckets = 256;
+        C.buckets = (cache_entry**)calloc(C.nbuckets, sizeof(cache_entry*));
+        if (!C.buckets) C.st.capacity = 0;
+    }
+    pthread_mutex_unlock(&C.mu);
+}
+
+bool cache_enabled(void) { return C.st.capacity > 0; }
+
+static size_t entry_cost(const cache_entry *e) {
+    return sizeof(*e) + e->lang_len + 1 + e->code_len + e->payload_len;
+}
+
+static void lru_unlink(cache_entry *e) {
+    if (e->prev) e->prev->next = e->next; else C.head = e->next;
+    if (e->next) e->next->prev = e->prev; else C.tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(cache_entry *e) {
+    e->prev = NULL;
+    e->next = C.head;
+    if (C.head) C.head->prev = e; else C.tail = e;
+    C.head = e;
+}
+
+static bool key_equals(const cache_entry *e, uint64_t hash, const char *language, size_t lang_len,
+                       const char *code, size_t code_len) {
+    return e->hash == hash && e->lang_len == lang_len && e->code_len == code_len &&
+           memcmp(e->key, language, lang_len) == 0 &&
+           memcmp(e->key + lang_len + 1, code, code_len) == 0;
+}
+
+static cache_entry **bucket_slot(cache_entry *e) {
+    cache_entry **pp = &C.buckets[e->hash & (C.nbuckets - 1)];
+    while (*pp && *pp != e) pp = &(*pp)->chain;
+    return pp;
+}
+
+static void evict(cache_entry *e) {
+    cache_entry **pp = bucket_slot(e);
+    if (*pp) *pp = e->chain;
+    lru_unlink(e);
+    C.st.bytes -= entry_cost(e);
+    C.st.entries--;
+    free(e->payload);
+    free(e);
+}
+
+// double the bucket array once chains average more than one entry
+static void maybe_grow(void) {
+    if (C.st.entries <= C.nbuckets) return;
+    size_t n = C.nbuckets * 2;
+    cache_entry **nb = (cache_entry**)calloc(n, sizeof(cache_entry*));
+    if (!nb) return;
+    for (size_t i = 0; i < C.nbuckets; i++) {
+        cache_entry *e = C.buckets[i];
+        while (e) {
+            cache_entry *next = e->chain;
+            e->chain = nb[e->hash & (n - 1)];
+            nb[e->hash & (n - 1)] = e;
+            e = next;
+        }
+    }
+    free(C.buckets);
+    C.buckets = nb;
+    C.nbuckets = n;
+}
+
+char *cache_get(uint64_t hash, const char *language, const char *code, size_t code_len, size_t *payload_len) {
+    if (!cache_enabled()) return NULL;
+    size_t lang_len = strlen(language);
+    char *out = NULL;
+
+    pthread_mutex_lock(&C.mu);
+    cache_entry *e = C.buckets[hash & (C.nbuckets - 1)];
+    while (e && !key_equals(e, hash, language, lang_len, code, code_len)) e = e->chain;
+    if (e) {
+        lru_unlink(e);
+        lru_push_front(e);
+        out = (char*)malloc(e->payload_len + 1);
+        if (out) {
+            memcpy(out, e->payload, e->payload_len + 1);
+            *payload_len = e->payload_len;
+        }
+        C.st.hits++;
+    } else {
+        C.st.misses++;
+    }
+    pthread_mutex_unlock(&C.mu);
+    return out;
+}
+
+void cache_put(uint64_t hash, const char *language, const char *code, size_t code_len,
+               const char *payload, size_t payload_len) {
+    if (!cache_enabled()) return;
+    size_t lang_len = strlen(language);
+    size_t cost = sizeof(cache_entry) + lang_len + 1 + code_len + payload_len;
+    if (cost > C.max_entry || cost > C.st.capacity) return;
+
+    // build outside the lock; only linking it in is serialized
+    cache_entry *e = (cache_entry*)malloc(sizeof(cache_entry) + lang_len + 1 + code_len);
+    if (!e) return;
+    e->payload = (char*)malloc(payload_len + 1);
+    if (!e->payload) { free(e); return; }
+    e->hash = hash;
+    e->chain = e->prev = e->next = NULL;
+    e->lang_len = lang_len;
+    e->code_len = code_len;
+    e->payload_len = payload_len;
+    memcpy(e->key, language, lang_len + 1);
+    memcpy(e->key + lang_len + 1, code, code_len);
+    memcpy(e->payload, payload, payload_len);
+    e->payload[payload_len] = '\0';
+
+    pthread_mutex_lock(&C.mu);
+    cache_entry *old = C.buckets[hash & (C.nbuckets - 1)];
+    while (old && !key_equals(old, hash, language, lang_len, code, code_len)) old = old->chain;
+    if (old) evict(old); // a concurrent miss on the same key got here first
+
+    while (C.tail && C.st.bytes + cost > C.st.capacity) {
+        evict(C.tail);
+        C.st.evictions++;
+    }
+    cache_entry **slot = &C.buckets[hash & (C.nbuckets - 1)];
+    e->chain = *slot;
+    *slot = e;
+    lru_push_front(e);
+    C.st.bytes += cost;
+    C.st.entries++;
+    C.st.inserts++;
+    maybe_grow();
+    pthread_mutex_unlock(&C.mu);
+}
+
+cache_stats cache_get_stats(void) {
+    pthread_mutex_lock(&C.mu);
+    cache_stats st = C.st;
+    pthread_mutex_unlock(&C.mu);
+    return st;
+}
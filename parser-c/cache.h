@@ -0,0 +1,35 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* In-process LRU cache of finished /parse payloads, keyed by a hash of
+   (language, code). Bounded by the bytes it holds: keys, payloads and
+   entry bookkeeping all count against the capacity. Thread-safe. */
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts;
+    uint64_t evictions;
+    size_t   entries;
+    size_t   bytes;
+    size_t   capacity;
+} cache_stats;
+
+// capacity_bytes == 0 disables the cache; entries above max_entry_bytes are never stored
+void cache_init(size_t capacity_bytes, size_t max_entry_bytes);
+bool cache_enabled(void);
+
+uint64_t cache_hash(const char *language, const char *code, size_t code_len);
+
+// malloc'd copy of the cached payload (caller frees), or NULL on a miss
+char *cache_get(uint64_t hash, const char *language, const char *code, size_t code_len, size_t *payload_len);
+void  cache_put(uint64_t hash, const char *language, const char *code, size_t code_len,
+                const char *payload, size_t payload_len);
+
+cache_stats cache_get_stats(void);
+
+#endif
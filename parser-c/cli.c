@@ -0,0 +1,213 @@
+#include "cli.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "json.h"
+#include "parse.h"
+#include "workpool.h"
+
+typedef struct {
+    char **paths;
+    size_t n, cap;
+    bool oom;
+} path_list;
+
+typedef struct {
+    path_list *files;
+    pthread_mutex_t mu;  // serializes stdout
+    size_t failures;
+} cli_ctx;
+
+/* --------------------------- inputs --------------------------- */
+
+static void add_path(path_list *L, const char *path) {
+    if (L->oom) return;
+    if (L->n == L->cap) {
+        size_t ncap = L->cap ? L->cap * 2 : 64;
+        char **p = (char**)realloc(L->paths, ncap * sizeof(char*));
+        if (!p) { L->oom = true; return; }
+        L->paths = p;
+        L->cap = ncap;
+    }
+    char *copy = strdup(path);
+    if (!copy) { L->oom = true; return; }
+    L->paths[L->n++] = copy;
+}
+
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// source files below dir (see parse_language_for_path), in name order; hidden entries and symlinked directories are skipped
+static void collect_dir(path_list *L, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        add_path(L, dir);  // reported as an error when it is analyzed
+        return;
+    }
+    path_list here = {0};
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        size_t len = strlen(dir) + strlen(e->d_name) + 2;
+        char *child = (char*)malloc(len);
+        if (!child) { L->oom = true; break; }
+        snprintf(child, len, "%s%s%s", dir, dir[strlen(dir) - 1] == '/' ? "" : "/", e->d_name);
+        struct stat st;
+        bool keep = false;
+        if (lstat(child, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) keep = true;
+            else if (parse_language_for_path(e->d_name)) keep = S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode) && stat(child, &st) == 0 && S_ISREG(st.st_mode));
+        }
+        if (keep) add_path(&here, child);
+        free(child);
+    }
+    closedir(d);
+    if (here.oom) L->oom = true;
+
+    qsort(here.paths, here.n, sizeof(char*), cmp_str);
+    for (size_t i = 0; i < here.n; i++) {
+        struct stat st;
+        if (lstat(here.paths[i], &st) == 0 && S_ISDIR(st.st_mode)) collect_dir(L, here.paths[i]);
+        else add_path(L, here.paths[i]);
+        free(here.paths[i]);
+    }
+    free(here.paths);
+}
+
+static char *read_stdin(size_t *len) {
+    size_t cap = 64 * 1024, n = 0;
+    char *buf = (char*)malloc(cap);
+    while (buf) {
+        if (n == cap) {
+            char *p = (char*)realloc(buf, cap * 2);
+            if (!p) { free(buf); return NULL; }
+            buf = p;
+            cap *= 2;
+        }
+        ssize_t r = read(STDIN_FILENO, buf + n, cap - n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) { free(buf); return NULL; }
+        if (r == 0) break;
+        n += (size_t)r;
+    }
+    *len = n;
+    return buf;
+}
+
+/* --------------------------- analysis --------------------------- */
+
+// one line per file; when its document could not be encoded, an error line that still names it
+static void emit(cli_ctx *C, const char *path, json_writer *w, bool ok) {
+    json_writer fallback;
+    jw_init(&fallback);
+    if (w->failed) {
+        jw_object_begin(&fallback);
+        jw_key(&fallback, "path");
+        jw_string(&fallback, path);
+        jw_key(&fallback, "error");
+        jw_string(&fallback, "json encode failed");
+        jw_object_end(&fallback);
+        w = &fallback;
+        ok = false;
+    }
+    pthread_mutex_lock(&C->mu);
+    if (w->failed) fputs("{\"error\":\"json encode failed\"}", stdout);  // not even the path fit
+    else fwrite(w->buf, 1, w->len, stdout);
+    fputc('\n', stdout);
+    if (!ok) C->failures++;
+    pthread_mutex_unlock(&C->mu);
+    jw_free(&fallback);
+}
+
+static void analyze_task(void *arg, size_t i) {
+    cli_ctx *C = (cli_ctx*)arg;
+    const char *path = C->files->paths[i];
+    bool from_stdin = strcmp(path, "-") == 0;
+
+    json_writer w;
+    jw_init(&w);
+    jw_object_begin(&w);
+    jw_key(&w, "path");
+    jw_string(&w, path);
+
+    const char *error = NULL;
+    char *code = NULL;
+    size_t len = 0;
+    bool mapped = false;
+    if (from_stdin) {
+        code = read_stdin(&len);
+        if (!code) error = strerror(errno ? errno : ENOMEM);
+    } else {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            error = strerror(errno);
+        } else if (!S_ISREG(st.st_mode)) {
+            error = S_ISDIR(st.st_mode) ? "is a directory" : "not a regular file";
+        } else if ((uint64_t)st.st_size > UINT32_MAX) {
+            error = "file too large";  // tree-sitter offsets are 32-bit
+        } else if (st.st_size > 0) {
+            void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                error = strerror(errno);
+            } else {
+                madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+                code = (char*)p;
+                len = (size_t)st.st_size;
+                mapped = true;
+            }
+        }
+        if (fd >= 0) close(fd);
+    }
+
+    // stdin, and files named on the command line with another extension, are read as C
+    const char *language = from_stdin ? NULL : parse_language_for_path(path);
+    if (!error) error = parse_code_n(language ? language : "c", code, len, NULL, &w).error;
+    if (error) {
+        jw_key(&w, "error");
+        jw_string(&w, error);
+    }
+    jw_object_end(&w);
+    emit(C, path, &w, error == NULL);
+    jw_free(&w);
+
+    if (mapped) munmap(code, len);
+    else free(code);
+}
+
+int cli_analyze(char *const *paths, size_t npaths) {
+    path_list files = {0};
+    if (npaths == 0) add_path(&files, "-");
+    for (size_t i = 0; i < npaths; i++) {
+        struct stat st;
+        if (strcmp(paths[i], "-") != 0 && stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) collect_dir(&files, paths[i]);
+        else add_path(&files, paths[i]);
+    }
+    if (files.oom) {
+        fprintf(stderr, "parser: out of memory while listing files\n");
+        return 1;
+    }
+
+    cli_ctx C = { .files = &files };
+    pthread_mutex_init(&C.mu, NULL);
+    workpool_run(files.n, analyze_task, &C);
+    pthread_mutex_destroy(&C.mu);
+    fflush(stdout);
+
+    for (size_t i = 0; i < files.n; i++) free(files.paths[i]);
+    free(files.paths);
+    if (C.failures) fprintf(stderr, "parser: %zu of %zu files failed\n", C.failures, files.n);
+    return C.failures ? 1 : 0;
+}
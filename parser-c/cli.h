@@ -0,0 +1,16 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include <stddef.h>
+
+/* Offline mode: `parser --analyze path...` analyzes files without the
+   HTTP server. Directories are searched recursively for .c files (and
+   .cc, .cpp, .cxx, .c++ when C++ is built in, analyzed as "cpp"), "-"
+   (or no path at all) reads one source from stdin. Files are spread over
+   the work pool (see workpool.h) and every result is written to stdout as
+   soon as it is ready, one NDJSON line per file:
+     {"path":"...","ast":{...},"summary":{...}}  or  {"path":"...","error":"..."}
+   Returns the process exit status: 0 when every file was analyzed. */
+int cli_analyze(char *const *paths, size_t npaths);
+
+#endif
@@ -1,39 +1,32 @@
 #include "http.h"
+#include "metrics.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <time.h>
 #include <ctype.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 
-#define MAX_ROUTES 8
+#define CONN_QUEUE_CAP 1024
+#define ACCEPT_EVENTS 16
+#define CHEAP_BODY_BYTES (16u << 10)  // requests with at most this much body take the fast lane
+#define CHEAP_RUN_MAX 8               // fast-lane pops in a row before a waiting large one goes
 
-typedef struct {
-	char method[8];
-	char path[64];
-	route_handler handler;
-} route_entry;
-
-static route_entry ROUTES[MAX_ROUTES];
-static int ROUTE_COUNT = 0;
-
-static int starts_with(const char *s, const char *pfx) {
-	return strncmp(s, pfx, strlen(pfx)) == 0;
-}
-
-static void trim_crlf(char *s) {
-    if (!s) return;
-    size_t len = strlen(s);
-    while (len > 0 && (s[len-1] == '\r' || s[len-1] == '\n')) {
-        s[--len] = '\0';
-    }
-}
-
-http_server http_listen(int port) {
+http_server http_listen(int port, int backlog) {
 	http_server srv = { .port = port, .server_fd = -1 };
 
 	int fd = socket (AF_INET, SOCK_STREAM, 0);
@@ -54,7 +47,7 @@ http_server http_listen(int port) {
 		return srv;
 	}
 
-	if(listen(fd, 16) < 0) {
+	if(listen(fd, backlog > 0 ? backlog : HTTP_DEFAULT_BACKLOG) < 0) {
 		perror("listen");
 		close(fd);
 		return srv;
@@ -73,170 +66,938 @@ void http_close(http_server *srv) {
 	}
 }
 
+/* --------------------------- routing ---------------------------
+   Routes are compiled into a trie with one node per path segment (every
+   '/' starts one, so "/" is a single empty segment and "/parse/" differs
+   from "/parse"). A node has its literal children and at most one ":name"
+   child that matches any non-empty segment; literals are tried first and
+   the match backtracks into the parameter when they lead nowhere. Nodes
+   are allocated when routes are registered; matching only records
+   pointers into the request path.
+*/
+
+typedef struct route_method {
+	char method[8];
+	route_handler handler;
+	struct route_method *next;
+} route_method;
+
+typedef struct route_node {
+	char *segment;                   // literal text, or the name of a ":name" node
+	size_t segment_len;
+	struct route_node *children;     // literal children
+	struct route_node *next;         // next literal sibling
+	struct route_node *param_child;  // the ":name" child, if any
+	route_method *methods;           // handlers for a route ending here
+} route_node;
+
+static route_node ROUTE_ROOT;
+
+static route_node *route_child(route_node *n, const char *seg, size_t len) {
+	bool param = len > 0 && seg[0] == ':';
+	if(param) {
+		seg++; len--;
+		route_node *c = n->param_child;
+		if(c && (c->segment_len != len || memcmp(c->segment, seg, len) != 0))
+			fprintf(stderr, "[http] route parameter :%.*s already registered as :%s\n", (int)len, seg, c->segment);
+		if(c) return c;
+	} else {
+		for(route_node *c = n->children; c; c = c->next) {
+			if(c->segment_len == len && memcmp(c->segment, seg, len) == 0) return c;
+		}
+	}
+	route_node *c = (route_node*)calloc(1, sizeof(route_node));
+	if(!c || !(c->segment = strndup(seg, len))) { free(c); return NULL; }
+	c->segment_len = len;
+	if(param) {
+		n->param_child = c;
+	} else {
+		c->next = n->children;
+		n->children = c;
+	}
+	return c;
+}
+
 void http_route(const char *method, const char *path, route_handler handler) {
-	if(ROUTE_COUNT >= MAX_ROUTES) return;
-	route_entry *e = &ROUTES[ROUTE_COUNT++];
-	snprintf(e->method, sizeof(e->method), "%s", method);
-	snprintf(e->path, sizeof(e->path), "%s", path);
-	e->handler = handler;
+	route_node *n = &ROUTE_ROOT;
+	for(const char *p = path; n && *p == '/'; ) {
+		size_t len = strcspn(p + 1, "/");
+		n = route_child(n, p + 1, len);
+		p += 1 + len;
+	}
+	route_method *m = n && path[0] == '/' ? (route_method*)calloc(1, sizeof(route_method)) : NULL;
+	if(!m) {
+		fprintf(stderr, "[http] cannot register route %s %s\n", method, path);
+		return;
+	}
+	snprintf(m->method, sizeof(m->method), "%s", method);
+	m->handler = handler;
+	m->next = n->methods;
+	n->methods = m;
 }
 
-static route_handler find_route(const char *method, const char *path) {
-	for(int i = 0; i < ROUTE_COUNT; i++) {
-		if(strcmp(ROUTES[i].method, method) == 0 && strcmp(ROUTES[i].path, path) == 0) {
-			return ROUTES[i].handler;
-		}
+// node for the rest of the path p ("" or "/segment..."), recording parameters in req
+static const route_node *route_match(const route_node *n, const char *p, http_request *req) {
+	if(*p == '\0') return n->methods ? n : NULL;
+	const char *seg = p + 1;
+	size_t len = strcspn(seg, "/");
+	for(const route_node *c = n->children; c; c = c->next) {
+		if(c->segment_len != len || memcmp(c->segment, seg, len) != 0) continue;
+		const route_node *r = route_match(c, seg + len, req);
+		if(r) return r;
+	}
+	if(n->param_child && len > 0 && req->param_count < HTTP_MAX_PARAMS) {
+		size_t k = req->param_count++;
+		req->params[k] = (http_param){ n->param_child->segment, seg, len };
+		const route_node *r = route_match(n->param_child, seg + len, req);
+		if(r) return r;
+		req->param_count = k;
 	}
 	return NULL;
 }
 
-static int recv_line(int fd, char *buf, size_t maxlen) {
-	size_t i = 0;
-	while(i < maxlen - 1) {
-		char c;
-		int n = recv(fd, &c, 1, 0);
-		if(n <= 0) return (int)n;
-		buf[i++] = c;
-		if(c == '\n') break;
+// handler for the request; NULL with *path_known when only the method is wrong
+static route_handler find_route(http_request *req, bool *path_known) {
+	*path_known = false;
+	req->param_count = 0;
+	const route_node *n = req->path[0] == '/' ? route_match(&ROUTE_ROOT, req->path, req) : NULL;
+	if(!n) return NULL;
+	*path_known = true;
+	for(const route_method *m = n->methods; m; m = m->next) {
+		if(strcmp(m->method, req->method) == 0) return m->handler;
 	}
-	buf[i] = '\0';
-	return (int)i;
+	return NULL;
 }
 
-static void send_all(int fd, const char *buf, size_t len) {
+static int send_all(int fd, const char *buf, size_t len) {
 	size_t off = 0;
 	while (off < len) {
-		ssize_t n = send(fd, buf + off, len - off, 0);
-		if(n <= 0) return;
+		ssize_t n = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return -1;
 		off += (size_t)n;
+		metrics_bytes_out((size_t)n);
+	}
+	return 0;
+}
+
+// send every iovec in order with one sendmsg per partial write; iov is consumed
+static int send_iov(int fd, struct iovec *iov, int iovcnt) {
+	while(iovcnt > 0) {
+		struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (size_t)iovcnt };
+		ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return -1;
+		metrics_bytes_out((size_t)n);
+		size_t sent = (size_t)n;
+		while(iovcnt > 0 && sent >= iov->iov_len) {
+			sent -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt > 0) {
+			iov->iov_base = (char*)iov->iov_base + sent;
+			iov->iov_len -= sent;
+		}
+	}
+	return 0;
+}
+
+static const char *status_reason(int status) {
+	switch(status) {
+		case 200: return "OK";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 408: return "Request Timeout";
+		case 417: return "Expectation Failed";
+		case 413: return "Payload Too Large";
+		case 431: return "Request Header Fields Too Large";
+		case 500: return "Internal Server Error";
+		case 501: return "Not Implemented";
+		case 503: return "Service Unavailable";
+		default:  return status < 400 ? "OK" : "Error";
 	}
 }
 
-static void write_response(int fd, http_response *res) {
+static int write_response(int fd, http_response *res, bool keep_alive) {
 	char header[512];
 	const char *ct = res->content_type ? res->content_type : "text/plain; charset=utf-8";
 	int n = snprintf(header, sizeof(header),
-			"HTTP/1.1 %d OK\r\n"
+			"HTTP/1.1 %d %s\r\n"
 			"Content-Type: %s\r\n"
 			"Content-Length: %zu\r\n"
-			"Connection: close\r\n"
+			"Connection: %s\r\n"
+			"\r\n",
+			res->status, status_reason(res->status), ct, res->body_len, keep_alive ? "keep-alive" : "close");
+	metrics_response(res->status);
+	// head and body in one segment where they fit, so small replies don't wait on a delayed ACK
+	struct iovec iov[2] = {
+		{ .iov_base = header, .iov_len = (size_t)n },
+		{ .iov_base = res->body, .iov_len = res->body ? res->body_len : 0 },
+	};
+	return send_iov(fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+}
+
+/* --------------------------- streamed responses --------------------------- */
+
+struct http_stream {
+	int fd;
+	bool keep_alive;   // decided before dispatch; cleared when the body cannot be chunked
+	bool chunked;
+	bool started;
+	bool failed;
+	int status;        // as sent by http_stream_begin, for the request log
+};
+
+int http_stream_begin(http_request *req, int status, const char *content_type) {
+	http_stream *st = req->stream;
+	if(!st || st->started) return -1;
+	st->started = true;
+	st->status = status;
+	if(!st->chunked) st->keep_alive = false;
+	metrics_response(status);
+	char header[512];
+	int n = snprintf(header, sizeof(header),
+			"HTTP/1.1 %d %s\r\n"
+			"Content-Type: %s\r\n"
+			"%s"
+			"Connection: %s\r\n"
 			"\r\n",
-			res->status, ct, res->body_len);
-	send_all(fd, header, (size_t)n);
-	if(res->body && res->body_len > 0) {
-		send_all(fd, res->body, res->body_len);
-	}
-}
-
-static void handle_client(int cfd) {
-    char line[4096];
-    char method[8] = {0};
-    char path[64]  = {0};
-    char httpver[16] = {0};
-
-    // request line
-    if (recv_line(cfd, line, sizeof(line)) <= 0) {
-        close(cfd);
-        return;
-    }
-    trim_crlf(line);
-
-    if (sscanf(line, "%7s %63s %15s", method, path, httpver) != 3) {
-        // malformed request line
-        http_response bad = http_text(400, "Bad Request");
-        write_response(cfd, &bad);
-        http_response_free(&bad);
-        close(cfd);
-        return;
-    }
-    fprintf(stderr, "[http] %s %s %s\n", method, path, httpver);
-
-    // headers
-size_t content_length = 0;
-int header_lines = 0;
-
-for (;;) {
-    int n = recv_line(cfd, line, sizeof(line));
-    if (n <= 0) {
-        // client closed or error
-        close(cfd);
-        return;
-    }
-    trim_crlf(line);
-
-    // debug: show each header as parsed
-    fprintf(stderr, "[http] header: \"%s\"\n", line);
-
-    if (line[0] == '\0') {
-        // blank line -> end of headers
-        break;
-    }
-
-    if (starts_with(line, "Content-Length:")) {
-        const char *p = line + strlen("Content-Length:");
-        while (*p == ' ' || *p == '\t') p++;
-        content_length = (size_t)strtoul(p, NULL, 10);
-    }
-
-    // don't loop forever if blank line never arrives
-    if (++header_lines > 200) {
-        http_response bad = http_text(400, "Bad Request: header too long");
-        write_response(cfd, &bad);
-        http_response_free(&bad);
-        close(cfd);
-        return;
-    }
-}
-
-
-    // body (only if content-length > 0, e.g., POST /parse)
-    char *body = NULL;
-    if (content_length > 0) {
-        body = (char*)malloc(content_length + 1);
-        if (!body) { close(cfd); return; }
-        size_t got = 0;
-        while (got < content_length) {
-            ssize_t k = recv(cfd, body + got, content_length - got, 0);
-            if (k <= 0) { free(body); close(cfd); return; }
-            got += (size_t)k;
-        }
-        body[content_length] = '\0';
-    }
-
-    http_request req = {0};
-    snprintf(req.method, sizeof(req.method), "%s", method);
-    snprintf(req.path,   sizeof(req.path),   "%s", path);
-    req.body = body;
-    req.body_len = content_length;
-
-    // route dispatch
-    http_response res;
-    route_handler h = find_route(req.method, req.path);
-    if (h) res = h(&req);
-    else   res = http_json(404, "{\"error\":\"not found\"}");
-
-    // send response
-    write_response(cfd, &res);
-    http_response_free(&res);
-    http_request_free(&req);
-    close(cfd);
+			status, status_reason(status), content_type ? content_type : "text/plain; charset=utf-8",
+			st->chunked ? "Transfer-Encoding: chunked\r\n" : "", st->keep_alive ? "keep-alive" : "close");
+	if(send_all(st->fd, header, (size_t)n) < 0) st->failed = true;
+	return st->failed ? -1 : 0;
+}
+
+int http_stream_write(http_request *req, const char *data, size_t len) {
+	http_stream *st = req->stream;
+	if(!st || !st->started || st->failed) return -1;
+	if(len == 0) return 0; // an empty chunk would end the body
+	if(st->chunked) {
+		char size[24];
+		int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+		struct iovec iov[3] = {
+			{ .iov_base = size, .iov_len = (size_t)n },
+			{ .iov_base = (void*)data, .iov_len = len },
+			{ .iov_base = "\r\n", .iov_len = 2 },
+		};
+		if(send_iov(st->fd, iov, 3) < 0) st->failed = true;
+	} else if(send_all(st->fd, data, len) < 0) {
+		st->failed = true;
+	}
+	return st->failed ? -1 : 0;
+}
+
+http_response http_streamed(void) {
+	http_response r = {0};
+	r.status = 200;
+	r.streamed = true;
+	return r;
 }
 
+// terminate a streamed body; false when the connection cannot be reused
+static bool stream_finish(http_stream *st) {
+	if(!st->failed && st->chunked && send_all(st->fd, "0\r\n\r\n", 5) < 0) st->failed = true;
+	return st->keep_alive && !st->failed;
+}
+
+/* --------------------------- connections --------------------------- */
+
+typedef struct http_conn {
+	int fd;
+	int served;                   // requests answered on this connection
+	size_t buf_len;               // bytes in buf not yet consumed by a request
+	char buf[HTTP_MAX_HEADER_BYTES];
+	uint64_t idle_since_ms;
+	uint64_t queued_ns;           // when the acceptor handed it to the workers
+	struct http_conn *prev, *next; // idle list links, owned by SERVE.idle_mu
+	bool idle;
+} http_conn;
+
+static struct {
+	int ep;
+	int keepalive_timeout_ms;
+	int request_timeout_ms;
+	int max_requests;
+	int max_inflight;
+	const char *costly_query;
+	int workers;
+	atomic_int admitted;          // connections queued for or held by a worker
+	size_t max_body;
+	int log_every;
+	atomic_uint log_seq;
+	pthread_mutex_t idle_mu;
+	http_conn *idle_head, *idle_tail; // oldest first
+} SERVE = { .ep = -1, .idle_mu = PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static void conn_close(http_conn *c) {
+	close(c->fd);
+	free(c);
+	metrics_connections(-1);
+}
+
+// HTTP/1.1 defaults to persistent connections, HTTP/1.0 has to ask for one
+static bool wants_keep_alive(const char *httpver, const char *conn_hdr) {
+	if(conn_hdr) {
+		if(strcasecmp(conn_hdr, "close") == 0) return false;
+		if(strcasecmp(conn_hdr, "keep-alive") == 0) return true;
+	}
+	return strcmp(httpver, "HTTP/1.1") == 0;
+}
+
+const char *http_header_get(const http_request *req, const char *name) {
+	for(size_t i = 0; i < req->header_count; i++) {
+		if(strcasecmp(req->headers[i].name, name) == 0) return req->headers[i].value;
+	}
+	return NULL;
+}
+
+static int hex_value(char c) {
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// percent-decode [v, end) into out, NUL-terminated and truncated to out_size - 1
+static void percent_decode(const char *v, const char *end, bool plus_is_space, char *out, size_t out_size) {
+	size_t o = 0;
+	while(v < end && o + 1 < out_size) {
+		int hi, lo;
+		if(*v == '+' && plus_is_space) { out[o++] = ' '; v++; }
+		else if(*v == '%' && end - v >= 3 && (hi = hex_value(v[1])) >= 0 && (lo = hex_value(v[2])) >= 0) {
+			out[o++] = (char)(hi * 16 + lo);
+			v += 3;
+		} else out[o++] = *v++;
+	}
+	if(out_size) out[o] = '\0';
+}
+
+bool http_query_get(const http_request *req, const char *name, char *out, size_t out_size) {
+	size_t want = strlen(name);
+	for(const char *p = req->query; p && *p; ) {
+		size_t n = strcspn(p, "&");
+		size_t klen = strcspn(p, "=&");
+		if(klen == want && strncmp(p, name, want) == 0) {
+			percent_decode(p + klen + (p[klen] == '='), p + n, true, out, out_size);
+			return true;
+		}
+		p += n;
+		if(*p == '&') p++;
+	}
+	return false;
+}
+
+bool http_param_get(const http_request *req, const char *name, char *out, size_t out_size) {
+	for(size_t i = 0; i < req->param_count; i++) {
+		if(strcmp(req->params[i].name, name) != 0) continue;
+		percent_decode(req->params[i].value, req->params[i].value + req->params[i].value_len, false, out, out_size);
+		return true;
+	}
+	return false;
+}
+
+bool http_accepts(const http_request *req, const char *media_type) {
+	const char *p = http_header_get(req, "Accept");
+	size_t want = strlen(media_type);
+	while(p && *p) {
+		while(*p == ' ' || *p == '\t' || *p == ',') p++;
+		size_t n = strcspn(p, ",;");
+		while(n > 0 && (p[n-1] == ' ' || p[n-1] == '\t')) n--;
+		if(n == want && strncasecmp(p, media_type, n) == 0) return true;
+		p = strchr(p, ',');
+	}
+	return false;
+}
+
+static void send_error(int fd, int status, const char *text) {
+	http_response bad = {
+		.status = status, .body = (char*)text, .body_len = strlen(text),
+		.content_type = "text/plain; charset=utf-8", .body_static = true,
+	};
+	write_response(fd, &bad, false);
+}
+
+/* Fill c->buf until it holds a full request head (terminated by an empty
+   line). Returns the head length including the terminator, 0 when the peer
+   went away, or -1 when the head does not fit in HTTP_MAX_HEADER_BYTES. */
+static ssize_t read_head(http_conn *c) {
+	size_t scanned = 0;
+	for(;;) {
+		// only rescan the tail that could complete a terminator
+		size_t from = scanned > 3 ? scanned - 3 : 0;
+		for(size_t i = from; i < c->buf_len; i++) {
+			if(c->buf[i] != '\n') continue;
+			if(i >= 1 && c->buf[i-1] == '\n') return (ssize_t)(i + 1);
+			if(i >= 2 && c->buf[i-1] == '\r' && c->buf[i-2] == '\n') return (ssize_t)(i + 1);
+		}
+		scanned = c->buf_len;
+		if(c->buf_len == sizeof(c->buf)) return -1;
+
+		ssize_t n = recv(c->fd, c->buf + c->buf_len, sizeof(c->buf) - c->buf_len, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return 0;
+		c->buf_len += (size_t)n;
+		metrics_bytes_in((size_t)n);
+	}
+}
+
+// cut the next line out of [*p, end) in place; strips the CR/LF terminator
+static char *next_line(char **p, char *end) {
+	char *line = *p;
+	char *nl = memchr(line, '\n', (size_t)(end - line));
+	if(!nl) return NULL;
+	*p = nl + 1;
+	if(nl > line && nl[-1] == '\r') nl--;
+	*nl = '\0';
+	return line;
+}
+
+static char *next_token(char **p) {
+	while(**p == ' ') (*p)++;
+	if(!**p) return NULL;
+	char *tok = *p;
+	while(**p && **p != ' ') (*p)++;
+	if(**p) *(*p)++ = '\0';
+	return tok;
+}
+
+/* Parse request line and headers of c->buf[0, head_len) in place: the
+   method, path, version and header fields of req point into the buffer.
+   Returns 0 on success or the HTTP status to reject the request with. */
+static int parse_head(char *buf, size_t head_len, http_request *req) {
+	char *p = buf, *end = buf + head_len;
+
+	char *line = next_line(&p, end);
+	if(!line) return 400;
+	req->method  = next_token(&line);
+	req->path    = next_token(&line);
+	req->version = next_token(&line);
+	if(!req->method || !req->path || !req->version || next_token(&line)) return 400;
+	char *q = strchr(req->path, '?');
+	if(q) *q++ = '\0';
+	req->query = q ? q : "";
+
+	while((line = next_line(&p, end)) != NULL && line[0] != '\0') {
+		char *colon = strchr(line, ':');
+		if(!colon) return 400;
+		if(req->header_count == HTTP_MAX_HEADERS) return 431;
+		*colon = '\0';
+		char *v = colon + 1;
+		while(*v == ' ' || *v == '\t') v++;
+		char *ve = v + strlen(v);
+		while(ve > v && (ve[-1] == ' ' || ve[-1] == '\t')) *--ve = '\0';
+		req->headers[req->header_count].name = line;
+		req->headers[req->header_count].value = v;
+		req->header_count++;
+	}
+	return 0;
+}
+
+static void set_socket_timeout(int fd, int optname, uint64_t ms) {
+	struct timeval tv = { .tv_sec = (time_t)(ms / 1000), .tv_usec = (suseconds_t)(ms % 1000) * 1000 };
+	setsockopt(fd, SOL_SOCKET, optname, &tv, sizeof(tv));
+}
+
+/* When the request has to be answered by: the server's --request-timeout,
+   or the client's X-Request-Timeout (milliseconds) when that is shorter.
+   0 when neither sets one. */
+static uint64_t request_deadline(const http_request *req) {
+	uint64_t ms = SERVE.request_timeout_ms > 0 ? (uint64_t)SERVE.request_timeout_ms : 0;
+	const char *h = http_header_get(req, "X-Request-Timeout");
+	if(h && *h >= '0' && *h <= '9') {
+		char *end = NULL;
+		unsigned long long v = strtoull(h, &end, 10);
+		if(!*end && v > 0 && (ms == 0 || v < ms)) ms = v;
+	}
+	return ms ? metrics_now_ns() + ms * 1000000u : 0;
+}
+
+/* Read the body into a fresh allocation. Bytes that arrived together with
+   the head are taken from the connection buffer first; anything after the
+   body (a pipelined request) stays there. NULL when the peer went away,
+   or with *expired set when the deadline passed first. */
+static char *read_body(http_conn *c, size_t head_len, size_t content_length, uint64_t deadline_ns,
+                       bool *expired) {
+	*expired = false;
+	char *body = (char*)malloc(content_length + 1);
+	if(!body) return NULL;
+
+	size_t buffered = c->buf_len - head_len;
+	size_t got = buffered < content_length ? buffered : content_length;
+	memcpy(body, c->buf + head_len, got);
+
+	// a deadline closer than the keep-alive timeout bounds each recv instead
+	bool shortened = false;
+	while(got < content_length) {
+		if(deadline_ns) {
+			uint64_t now = metrics_now_ns();
+			if(now >= deadline_ns) { *expired = true; break; }
+			uint64_t left_ms = (deadline_ns - now) / 1000000u + 1;
+			if(left_ms < (uint64_t)SERVE.keepalive_timeout_ms) {
+				set_socket_timeout(c->fd, SO_RCVTIMEO, left_ms);
+				shortened = true;
+			}
+		}
+		ssize_t k = recv(c->fd, body + got, content_length - got, 0);
+		if(k < 0 && errno == EINTR) continue;
+		if(k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && deadline_ns &&
+		   metrics_now_ns() >= deadline_ns) { *expired = true; break; }
+		if(k <= 0) break;
+		got += (size_t)k;
+		metrics_bytes_in((size_t)k);
+	}
+	if(shortened) set_socket_timeout(c->fd, SO_RCVTIMEO, (uint64_t)SERVE.keepalive_timeout_ms);
+	if(got < content_length) { free(body); return NULL; }
+	body[content_length] = '\0';
+	return body;
+}
+
+// drop the bytes of the request just served, keeping what was pipelined behind it
+static void conn_consume(http_conn *c, size_t n) {
+	if(n >= c->buf_len) { c->buf_len = 0; return; }
+	memmove(c->buf, c->buf + n, c->buf_len - n);
+	c->buf_len -= n;
+}
+
+/* Everything after the head: body, dispatch and the response. Returns
+   true when the connection may carry another request; *status is what
+   the client was answered with. */
+static bool answer_request(http_conn *c, size_t head_len, http_request *req, int *status) {
+	int cfd = c->fd;
+	const char *te = http_header_get(req, "Transfer-Encoding");
+	if(te && strcasecmp(te, "identity") != 0) {
+		send_error(cfd, *status = 501, "Transfer-Encoding not supported");
+		return false;
+	}
+
+	size_t content_length = 0;
+	const char *cl = http_header_get(req, "Content-Length");
+	if(cl) {
+		char *cl_end = NULL;
+		errno = 0;
+		unsigned long long v = strtoull(cl, &cl_end, 10);
+		if(*cl < '0' || *cl > '9' || *cl_end || errno == ERANGE) {
+			send_error(cfd, *status = 400, "Bad Content-Length");
+			return false;
+		}
+		// refuse before allocating or reading anything; the unread body makes the connection unusable
+		if(v > SERVE.max_body) {
+			send_error(cfd, *status = 413, "Payload Too Large");
+			return false;
+		}
+		content_length = (size_t)v;
+	}
+
+	// a client waiting for permission to send the body gets it once the size is known to be acceptable
+	size_t buffered = c->buf_len - head_len;
+	const char *expect = http_header_get(req, "Expect");
+	if(expect) {
+		if(strcasecmp(expect, "100-continue") != 0) {
+			send_error(cfd, *status = 417, "Expectation Failed");
+			return false;
+		}
+		if(content_length > buffered && strcmp(req->version, "HTTP/1.1") == 0 &&
+		   send_all(cfd, "HTTP/1.1 100 Continue\r\n\r\n", 25) < 0) return false;
+	}
+
+	// body (only if content-length > 0, e.g., POST /parse)
+	req->deadline_ns = request_deadline(req);
+	if(content_length > 0) {
+		uint64_t t0 = metrics_now_ns();
+		bool expired;
+		req->body = read_body(c, head_len, content_length, req->deadline_ns, &expired);
+		if(expired) send_error(cfd, *status = 408, "Request Timeout");
+		if(!req->body) return false;
+		req->body_len = content_length;
+		metrics_observe(METRIC_BODY_READ, t0);
+	}
+
+	c->served++;
+	bool keep = wants_keep_alive(req->version, http_header_get(req, "Connection"));
+	if(SERVE.max_requests > 0 && c->served >= SERVE.max_requests) keep = false;
+
+	// route dispatch
+	http_stream stream = { .fd = cfd, .keep_alive = keep, .chunked = strcmp(req->version, "HTTP/1.1") == 0 };
+	req->stream = &stream;
+	http_response res;
+	bool path_known;
+	route_handler h = find_route(req, &path_known);
+	if(h) res = h(req);
+	else if(path_known) res = HTTP_JSON_LITERAL(405, "{\"error\":\"method not allowed\"}");
+	else  res = HTTP_JSON_LITERAL(404, "{\"error\":\"not found\"}");
+
+	// send response; a streamed body was written while the handler ran
+	if(res.streamed && stream.started) {
+		keep = stream_finish(&stream);
+		*status = stream.status;
+	} else {
+		if(res.streamed) res = HTTP_JSON_LITERAL(500, "{\"error\":\"empty stream\"}");
+		uint64_t t0 = metrics_now_ns();
+		if(write_response(cfd, &res, keep) < 0) keep = false;
+		metrics_observe(METRIC_WRITE, t0);
+		*status = res.status;
+	}
+	http_response_free(&res);
+	http_request_free(req);
+
+	// the head (and any body bytes read with it) is no longer referenced
+	conn_consume(c, head_len + (buffered < content_length ? buffered : content_length));
+	return keep;
+}
+
+// --log all logs every request, --log sample=N one in N
+static bool should_log(void) {
+	if(SERVE.log_every <= 0) return false;
+	return SERVE.log_every == 1 || atomic_fetch_add_explicit(&SERVE.log_seq, 1, memory_order_relaxed) % (unsigned)SERVE.log_every == 0;
+}
+
+/* Read, dispatch and answer one request. Returns true when the connection
+   may carry another request, false when it has to be closed. */
+static bool serve_request(http_conn *c) {
+	int cfd = c->fd;
+
+	uint64_t t0 = metrics_now_ns();
+	ssize_t head_len = read_head(c);
+	if(head_len == 0) return false;
+	if(head_len < 0) {
+		send_error(cfd, 431, "Request Header Fields Too Large");
+		return false;
+	}
+
+	http_request req = {0};
+	int bad = parse_head(c->buf, (size_t)head_len, &req);
+	if(bad) {
+		send_error(cfd, bad, bad == 431 ? "Request Header Fields Too Large" : "Bad Request");
+		return false;
+	}
+	metrics_observe(METRIC_HEADER_READ, t0);
+
+	// answer_request releases the head, so the log line is prepared first
+	char line[160] = "";
+	bool log = should_log();
+	if(log) snprintf(line, sizeof(line), "%s %s %s", req.method, req.path, req.version);
+
+	metrics_in_flight(1);
+	int status = 0;
+	bool keep = answer_request(c, (size_t)head_len, &req, &status);
+	metrics_in_flight(-1);
+
+	if(log) fprintf(stderr, "[http] %s %d %lluus\n", line, status,
+	                (unsigned long long)((metrics_now_ns() - t0) / 1000));
+	return keep;
+}
+
+/* --------------------------- idle connections ---------------------------
+   A keep-alive connection with nothing to read goes back to epoll
+   (EPOLLONESHOT) instead of occupying a worker. Parked connections sit on
+   a list in the order they went idle, so the event loop only has to look
+   at the head to expire the ones past the keep-alive timeout.
+*/
+
+static void idle_unlink(http_conn *c) {
+	if(!c->idle) return;
+	if(c->prev) c->prev->next = c->next; else SERVE.idle_head = c->next;
+	if(c->next) c->next->prev = c->prev; else SERVE.idle_tail = c->prev;
+	c->prev = c->next = NULL;
+	c->idle = false;
+}
+
+static void conn_park(http_conn *c) {
+	struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, .data.ptr = c };
+	pthread_mutex_lock(&SERVE.idle_mu);
+	c->idle_since_ms = now_ms();
+	c->prev = SERVE.idle_tail;
+	c->next = NULL;
+	if(SERVE.idle_tail) SERVE.idle_tail->next = c; else SERVE.idle_head = c;
+	SERVE.idle_tail = c;
+	c->idle = true;
+	int op = c->served == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+	int rc = epoll_ctl(SERVE.ep, op, c->fd, &ev);
+	if(rc < 0) idle_unlink(c);
+	pthread_mutex_unlock(&SERVE.idle_mu);
+	if(rc < 0) { perror("epoll_ctl"); conn_close(c); }
+}
+
+// close parked connections idle for longer than the keep-alive timeout
+static void idle_sweep(void) {
+	uint64_t now = now_ms();
+	pthread_mutex_lock(&SERVE.idle_mu);
+	while(SERVE.idle_head && now - SERVE.idle_head->idle_since_ms >= (uint64_t)SERVE.keepalive_timeout_ms) {
+		http_conn *c = SERVE.idle_head;
+		idle_unlink(c);
+		epoll_ctl(SERVE.ep, EPOLL_CTL_DEL, c->fd, NULL);
+		conn_close(c);
+	}
+	pthread_mutex_unlock(&SERVE.idle_mu);
+}
+
+// bytes of a pipelined request already waiting in the socket?
+static bool has_pending_input(int fd) {
+	char c;
+	ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return n > 0;
+}
+
+static void handle_client(http_conn *c) {
+	// pipelined requests are answered in order on this worker before parking
+	do {
+		if(!serve_request(c)) { conn_close(c); return; }
+	} while(c->buf_len > 0 || has_pending_input(c->fd));
+	conn_park(c);
+}
+
+
+/* --------------------------- worker pool ---------------------------
+   The acceptor thread (the caller of http_serve) waits on epoll for the
+   listening socket and for parked connections. Connections that become
+   readable are handed to a fixed set of workers through two bounded
+   rings, so a slow client only ties up the worker serving it. Requests
+   with no or a small body go in the fast lane and are served first;
+   after CHEAP_RUN_MAX of them in a row a waiting large one gets a turn.
+   Past --max-inflight the acceptor answers 503 itself instead of
+   queueing, so overload costs a rejected request rather than latency
+   for everyone behind it.
+*/
+
+typedef struct {
+	http_conn *items[CONN_QUEUE_CAP];
+	size_t head;
+	size_t len;
+} conn_ring;
+
+typedef struct {
+	conn_ring cheap, costly;
+	unsigned cheap_run;           // fast-lane pops since the last slow-lane one
+	pthread_mutex_t mu;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+} conn_queue;
+
+static conn_queue QUEUE = {
+	.mu = PTHREAD_MUTEX_INITIALIZER,
+	.not_empty = PTHREAD_COND_INITIALIZER,
+	.not_full = PTHREAD_COND_INITIALIZER,
+};
+
+static void queue_push(conn_queue *q, http_conn *c, bool cheap) {
+	conn_ring *r = cheap ? &q->cheap : &q->costly;
+	pthread_mutex_lock(&q->mu);
+	while(r->len == CONN_QUEUE_CAP) pthread_cond_wait(&q->not_full, &q->mu);
+	r->items[(r->head + r->len) % CONN_QUEUE_CAP] = c;
+	r->len++;
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->mu);
+}
+
+static http_conn *queue_pop(conn_queue *q) {
+	pthread_mutex_lock(&q->mu);
+	while(q->cheap.len == 0 && q->costly.len == 0) pthread_cond_wait(&q->not_empty, &q->mu);
+	bool cheap = q->cheap.len > 0 && (q->costly.len == 0 || q->cheap_run < CHEAP_RUN_MAX);
+	conn_ring *r = cheap ? &q->cheap : &q->costly;
+	q->cheap_run = cheap ? q->cheap_run + 1 : 0;
+	http_conn *c = r->items[r->head];
+	r->head = (r->head + 1) % CONN_QUEUE_CAP;
+	r->len--;
+	pthread_cond_broadcast(&q->not_full);
+	pthread_mutex_unlock(&q->mu);
+	return c;
+}
+
+static void *worker_main(void *arg) {
+	(void)arg;
+	for(;;) {
+		http_conn *c = queue_pop(&QUEUE);
+		metrics_observe(METRIC_QUEUE_WAIT, c->queued_ns);
+		handle_client(c);
+		atomic_fetch_sub_explicit(&SERVE.admitted, 1, memory_order_relaxed);
+	}
+	return NULL;
+}
+
+// the request line's query sets SERVE.costly_query, as a handler reading it as a flag would see it
+static bool sets_costly_query(const char *line, size_t len) {
+	const char *target = memchr(line, ' ', len);
+	if(!target) return false;
+	target++;
+	const char *end = memchr(target, ' ', len - (size_t)(target - line));
+	const char *q = end ? memchr(target, '?', (size_t)(end - target)) : NULL;
+	if(!q) return false;
+	size_t nlen = strlen(SERVE.costly_query);
+	for(const char *p = q + 1; p < end; ) {
+		const char *amp = memchr(p, '&', (size_t)(end - p));
+		if(!amp) amp = end;
+		if((size_t)(amp - p) >= nlen && strncmp(p, SERVE.costly_query, nlen) == 0 && (p + nlen == amp || p[nlen] == '=')) {
+			const char *v = p + nlen == amp ? amp : p + nlen + 1;
+			size_t vlen = (size_t)(amp - v);
+			return !(vlen == 1 && v[0] == '0') && !(vlen == 5 && strncmp(v, "false", 5) == 0);
+		}
+		p = amp + 1;
+	}
+	return false;
+}
+
+/* Small or bodiless requests are cheap to serve, unless they ask for
+   SERVE.costly_query. Decided from the bytes already waiting, without
+   consuming them; a head that does not fit the peek, or has not fully
+   arrived, counts as expensive. */
+static bool looks_cheap(int fd) {
+	char peek[2048];
+	ssize_t n = recv(fd, peek, sizeof(peek) - 1, MSG_PEEK | MSG_DONTWAIT);
+	if(n <= 0) return true;  // a hang-up is cheap to deal with
+	peek[n] = '\0';
+	char *eol = strchr(peek, '\n');
+	if(SERVE.costly_query && (!eol || sets_costly_query(peek, (size_t)(eol - peek)))) return false;
+	for(char *p = eol; p; p = strchr(p + 1, '\n')) {
+		if(p[1] == '\r' || p[1] == '\n') return true;  // end of the head, no Content-Length
+		if(strncasecmp(p + 1, "Content-Length:", 15) == 0) return strtoull(p + 16, NULL, 10) <= CHEAP_BODY_BYTES;
+	}
+	return false;
+}
+
+static const char OVERLOADED[] =
+	"HTTP/1.1 503 Service Unavailable\r\n"
+	"Content-Type: application/json; charset=utf-8\r\n"
+	"Content-Length: 22\r\n"
+	"Retry-After: 1\r\n"
+	"Connection: close\r\n"
+	"\r\n"
+	"{\"error\":\"overloaded\"}";
+
+/* Turn a readable connection away from the acceptor thread, without
+   blocking: take in what the client already sent (so closing does not
+   reset the connection under a short request), answer 503 and close. */
+static void shed(http_conn *c) {
+	while(c->buf_len < sizeof(c->buf)) {
+		ssize_t n = recv(c->fd, c->buf + c->buf_len, sizeof(c->buf) - c->buf_len, MSG_DONTWAIT);
+		if(n == 0) { conn_close(c); return; }  // the client left anyway
+		if(n < 0) break;
+		c->buf_len += (size_t)n;
+		metrics_bytes_in((size_t)n);
+	}
+	ssize_t n = send(c->fd, OVERLOADED, sizeof(OVERLOADED) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if(n > 0) metrics_bytes_out((size_t)n);
+	metrics_response(503);
+	metrics_rejected();
+	conn_close(c);
+}
+
+// hand a readable connection to the workers, or shed it past --max-inflight
+static void dispatch(http_conn *c) {
+	int admitted = atomic_load_explicit(&SERVE.admitted, memory_order_relaxed);
+	if(admitted >= SERVE.max_inflight) {
+		shed(c);
+		return;
+	}
+	atomic_fetch_add_explicit(&SERVE.admitted, 1, memory_order_relaxed);
+	c->queued_ns = metrics_now_ns();
+	// with a worker free nothing waits, so the lane only matters once they are all busy
+	queue_push(&QUEUE, c, admitted < SERVE.workers || looks_cheap(c->fd));
+}
+
+static int set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	if(flags < 0) return -1;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// accept until the backlog is drained; accepted fds stay blocking
+static void accept_pending(int lfd) {
+	for(;;) {
+		struct sockaddr_in cli;
+		socklen_t cl = sizeof(cli);
+		int cfd = accept(lfd, (struct sockaddr*)&cli, &cl);
+		if(cfd < 0) {
+			if(errno == EINTR) continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+			return;
+		}
+
+		// a client that stops sending mid-request, or stops reading the reply, can't hold a worker forever
+		set_socket_timeout(cfd, SO_RCVTIMEO, (uint64_t)SERVE.keepalive_timeout_ms);
+		set_socket_timeout(cfd, SO_SNDTIMEO, (uint64_t)SERVE.keepalive_timeout_ms);
+		// replies are written whole, so Nagle only adds latency
+		int one = 1;
+		setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		http_conn *c = (http_conn*)calloc(1, sizeof(http_conn));
+		if(!c) { close(cfd); continue; }
+		c->fd = cfd;
+		metrics_connections(1);
+		// wait for the first request on epoll rather than on a worker
+		conn_park(c);
+	}
+}
 
 void http_serve(http_server *srv) {
-  if (!srv || srv->server_fd < 0) return;
-
-  for (;;) {
-    struct sockaddr_in cli;
-    socklen_t cl = sizeof(cli);
-    int cfd = accept(srv->server_fd, (struct sockaddr*)&cli, &cl);
-    if (cfd < 0) {
-      if (errno == EINTR) continue;
-      perror("accept");
-      break;
-    }
-    handle_client(cfd);
-  }
+	if(!srv || srv->server_fd < 0) return;
+
+	int nthreads = srv->threads > 0 ? srv->threads : 1;
+	SERVE.keepalive_timeout_ms = srv->keepalive_timeout_ms > 0 ? srv->keepalive_timeout_ms : HTTP_DEFAULT_KEEPALIVE_MS;
+	SERVE.max_requests = srv->max_requests;
+	SERVE.max_body = srv->max_body_bytes > 0 ? srv->max_body_bytes : HTTP_DEFAULT_MAX_BODY_BYTES;
+	SERVE.log_every = srv->log_every;
+	SERVE.request_timeout_ms = srv->request_timeout_ms;
+	// every admitted connection fits in either ring, so the acceptor never blocks on one
+	SERVE.max_inflight = srv->max_inflight > 0 && srv->max_inflight < CONN_QUEUE_CAP ? srv->max_inflight : CONN_QUEUE_CAP;
+	SERVE.costly_query = srv->costly_query && *srv->costly_query ? srv->costly_query : NULL;
+	if(set_nonblocking(srv->server_fd) < 0) { perror("fcntl"); return; }
+
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	if(ep < 0) { perror("epoll_create1"); return; }
+	// the listening socket is tagged with a NULL pointer, connections with their http_conn
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	if(epoll_ctl(ep, EPOLL_CTL_ADD, srv->server_fd, &ev) < 0) {
+		perror("epoll_ctl");
+		close(ep);
+		return;
+	}
+	SERVE.ep = ep;
+
+	int started = 0;
+	for(int i = 0; i < nthreads; i++) {
+		pthread_t t;
+		if(pthread_create(&t, NULL, worker_main, NULL) != 0) {
+			perror("pthread_create");
+			break;
+		}
+		pthread_detach(t);
+		started++;
+	}
+	if(started == 0) { close(ep); SERVE.ep = -1; return; }
+	SERVE.workers = started;
+	fprintf(stderr, "[http] serving with %d worker thread(s), keep-alive %d ms, max %d requests/conn, max %d in flight\n",
+			started, SERVE.keepalive_timeout_ms, SERVE.max_requests, SERVE.max_inflight);
+
+	// wake up often enough to expire idle connections close to their deadline
+	int tick_ms = SERVE.keepalive_timeout_ms < 1000 ? SERVE.keepalive_timeout_ms : 1000;
+	struct epoll_event events[ACCEPT_EVENTS];
+	for(;;) {
+		int n = epoll_wait(ep, events, ACCEPT_EVENTS, tick_ms);
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			perror("epoll_wait");
+			break;
+		}
+		for(int i = 0; i < n; i++) {
+			http_conn *c = (http_conn*)events[i].data.ptr;
+			if(!c) { accept_pending(srv->server_fd); continue; }
+			pthread_mutex_lock(&SERVE.idle_mu);
+			idle_unlink(c);
+			pthread_mutex_unlock(&SERVE.idle_mu);
+			dispatch(c);
+		}
+		idle_sweep();
+	}
+	close(ep);
+	SERVE.ep = -1;
 }
 
 http_response http_json(int status, const char *json_utf8) {
@@ -252,6 +1013,25 @@ http_response http_json(int status, const char *json_utf8) {
   return r;
 }
 
+http_response http_json_take(int status, char *json_utf8, size_t len) {
+  http_response r = {0};
+  r.status = status;
+  r.content_type = "application/json; charset=utf-8";
+  r.body = json_utf8;
+  r.body_len = json_utf8 ? len : 0;
+  return r;
+}
+
+http_response http_json_static(int status, const char *json_utf8, size_t len) {
+  http_response r = {0};
+  r.status = status;
+  r.content_type = "application/json; charset=utf-8";
+  r.body = (char*)json_utf8;
+  r.body_len = json_utf8 ? len : 0;
+  r.body_static = true;
+  return r;
+}
+
 http_response http_text(int status, const char *text) {
   http_response r = {0};
   r.status = status;
@@ -267,9 +1047,10 @@ http_response http_text(int status, const char *text) {
 
 void http_response_free(http_response *res) {
   if (!res) return;
-  if (res->body) free(res->body);
+  if (res->body && !res->body_static) free(res->body);
   res->body = NULL;
   res->body_len = 0;
+  res->body_static = false;
 }
 
 void http_request_free(http_request *req) {
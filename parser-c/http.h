@@ -3,12 +3,46 @@
 #define HTTP_H
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
 
+#define HTTP_DEFAULT_KEEPALIVE_MS 5000
+#define HTTP_DEFAULT_BACKLOG 128
+#define HTTP_DEFAULT_MAX_BODY_BYTES (16u << 20)  // 16 MiB
+
+#define HTTP_MAX_HEADER_BYTES 16384   // request line + headers, per connection read buffer
+#define HTTP_MAX_HEADERS 64
+#define HTTP_MAX_PARAMS 8             // ":name" segments captured per request
+
+typedef struct {
+    const char *name;
+    const char *value;
+} http_header;
+
+// one ":name" path segment of the matched route; value is not NUL-terminated
+typedef struct {
+    const char *name;
+    const char *value;
+    size_t value_len;
+} http_param;
+
+typedef struct http_stream http_stream;
+
+/* method, path, query, version and headers point into the connection's
+   read buffer and are only valid while the handler runs */
 typedef struct {
-    char method[8];
-    char path[64];
+    const char *method;
+    const char *path;     // without the query string
+    const char *query;    // raw text after '?', "" when there is none
+    const char *version;
+    http_header headers[HTTP_MAX_HEADERS];
+    size_t header_count;
+    http_param params[HTTP_MAX_PARAMS];  // filled in by the router
+    size_t param_count;
     char *body;
     size_t body_len;
+    http_stream *stream;  // the connection, for handlers that stream (http_stream_begin)
+    uint64_t deadline_ns; // metrics_now_ns() time to have answered by, 0 = none; see request_timeout_ms
 } http_request;
 
 typedef struct {
@@ -16,24 +50,73 @@ typedef struct {
     char *body;
     size_t body_len;
     const char *content_type;
+    bool streamed;        // the handler already wrote the response through req->stream
+    bool body_static;     // body is borrowed (see http_json_static) and not freed
 } http_response;
 
 typedef struct {
     int port;
     int server_fd;
+    int threads;      // worker threads used by http_serve (<= 0 means 1)
+    int keepalive_timeout_ms;  // idle keep-alive connections are closed after this (<= 0: default)
+    int max_requests;          // per connection before "Connection: close" (<= 0: unlimited)
+    size_t max_body_bytes;     // larger bodies are refused with 413 before they are read (0: default)
+    int log_every;             // log one line per request: 0 never, 1 always, N one in N
+    /* budget for reading the body and running the handler (<= 0: none);
+       a client's X-Request-Timeout header (ms) may shorten it. A body
+       still arriving at the deadline is answered with 408. */
+    int request_timeout_ms;
+    /* connections with a request queued or being served; beyond it the
+       server answers 503 with Retry-After at once (<= 0: 1024 queued) */
+    int max_inflight;
+    /* a request whose query sets this parameter (present, not "0" or
+       "false") takes the slow lane whatever its size; NULL for none */
+    const char *costly_query;
 } http_server;
 
 typedef http_response (*route_handler)(http_request *req);
 
-http_server http_listen(int port);
+// backlog: pending connections the kernel holds before accept (<= 0: HTTP_DEFAULT_BACKLOG)
+http_server http_listen(int port, int backlog);
 void http_close(http_server *srv);
 void http_serve(http_server *srv);
 
+/* Register handler for method and path. A segment written ":name" matches
+   any non-empty segment and is passed to the handler (http_param_get);
+   literal segments win over a parameter at the same position. */
 void http_route(const char *method, const char *path, route_handler handler);
 
+// case-insensitive header lookup, NULL if absent
+const char *http_header_get(const http_request *req, const char *name);
+/* Percent-decoded value of query parameter `name` copied into out
+   (NUL-terminated, truncated to out_size - 1); a bare "name" yields "".
+   Returns false when the parameter is absent. */
+bool http_query_get(const http_request *req, const char *name, char *out, size_t out_size);
+// the same for the ":name" path parameter of the matched route
+bool http_param_get(const http_request *req, const char *name, char *out, size_t out_size);
+
+// true when the Accept header lists media_type itself (parameters such as q= are ignored)
+bool http_accepts(const http_request *req, const char *media_type);
+
 http_response http_json(int status, const char *json_utf8);
+// takes ownership of a malloc'd body instead of copying it
+http_response http_json_take(int status, char *json_utf8, size_t len);
+/* borrows a body that outlives the response, such as a string literal:
+   nothing is copied and http_response_free leaves it alone */
+http_response http_json_static(int status, const char *json_utf8, size_t len);
+#define HTTP_JSON_LITERAL(status, lit) http_json_static((status), "" lit, sizeof(lit) - 1)
 http_response http_text(int status, const char *text);
 
+/* Streamed responses: the handler sends the status line and headers with
+   http_stream_begin(), then the body in pieces as they become ready, and
+   returns http_streamed(). HTTP/1.1 clients get chunked transfer encoding
+   and keep the connection; HTTP/1.0 clients get a body delimited by
+   closing the connection. Both return -1 once the client is gone; callers
+   writing from several threads must serialize the calls themselves. */
+int  http_stream_begin(http_request *req, int status, const char *content_type);
+int  http_stream_write(http_request *req, const char *data, size_t len);
+http_response http_streamed(void);
+
 void http_response_free(http_response *res);
 void http_request_free(http_request *req);
 
@@ -1,4 +1,8 @@
 #include "json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 
 json_t *json_loads_safe(const char *s) {
 	if(!s) return NULL;
@@ -10,6 +14,12 @@ json_t *json_loads_safe(const char *s) {
 	return root;
 	}
 
+json_t *json_loadb_safe(const char *s, size_t len) {
+	if(!s) return NULL;
+	json_error_t err;
+	return json_loadb(s, len, 0, &err);
+}
+
 const char *json_get_string_else(json_t *obj, const char *key, const char *fallback) {
 	if(!obj || !key) return fallback;
 	json_t *v = json_object_get(obj, key);
@@ -17,3 +27,418 @@ const char *json_get_string_else(json_t *obj, const char *key, const char *fallb
 	return json_string_value(v);
 }
 
+
+/* --------------------------- streaming writer --------------------------- */
+
+void jw_init(json_writer *w) { memset(w, 0, sizeof(*w)); }
+
+void jw_init_format(json_writer *w, jw_format format) {
+	jw_init(w);
+	w->format = format;
+}
+
+void jw_free(json_writer *w) {
+	free(w->buf);
+	free(w->open_at);
+	jw_init(w);
+}
+
+void jw_reset(json_writer *w) {
+	char *buf = w->buf;
+	size_t cap = w->cap;
+	size_t *open_at = w->open_at;
+	jw_format format = w->format;
+	jw_init(w);
+	w->buf = buf;
+	w->cap = cap;
+	w->open_at = open_at;
+	w->format = format;
+}
+
+char *jw_take(json_writer *w, size_t *len) {
+	if(w->failed || !w->buf) {
+		jw_free(w);
+		if(len) *len = 0;
+		return NULL;
+	}
+	char *out = w->buf;
+	out[w->len] = '\0'; // jw_reserve always leaves room for it
+	if(len) *len = w->len;
+	w->buf = NULL;
+	w->cap = 0;
+	free(w->open_at); // only buf is handed out, and callers drop w after taking
+	w->open_at = NULL;
+	jw_reset(w);
+	return out;
+}
+
+static bool jw_reserve(json_writer *w, size_t extra) {
+	if(w->failed) return false;
+	if(w->len + extra + 1 <= w->cap) return true;
+	size_t cap = w->cap ? w->cap : 256;
+	while(cap < w->len + extra + 1) cap *= 2;
+	char *p = (char*)realloc(w->buf, cap);
+	if(!p) { w->failed = true; return false; }
+	w->buf = p;
+	w->cap = cap;
+	return true;
+}
+
+static void jw_put(json_writer *w, const char *s, size_t n) {
+	if(!jw_reserve(w, n)) return;
+	memcpy(w->buf + w->len, s, n);
+	w->len += n;
+}
+
+static void jw_putc(json_writer *w, char c) {
+	if(!jw_reserve(w, 1)) return;
+	w->buf[w->len++] = c;
+}
+
+// MessagePack: add n to the element count of the innermost open container
+static void mp_count(json_writer *w, size_t n) {
+	if(w->failed || w->depth == 0 || n == 0) return;
+	unsigned char *c = (unsigned char*)w->buf + w->open_at[w->depth - 1] + 1;
+	uint32_t v = ((uint32_t)c[0] << 24) | ((uint32_t)c[1] << 16) | ((uint32_t)c[2] << 8) | c[3];
+	v += (uint32_t)n;
+	c[0] = (unsigned char)(v >> 24); c[1] = (unsigned char)(v >> 16); c[2] = (unsigned char)(v >> 8); c[3] = (unsigned char)v;
+}
+
+// MessagePack: a type byte followed by `bytes` big-endian bytes of v
+static void mp_tagged(json_writer *w, unsigned char tag, uint64_t v, int bytes) {
+	unsigned char b[9];
+	b[0] = tag;
+	for(int i = 0; i < bytes; i++) b[1 + i] = (unsigned char)(v >> (8 * (bytes - 1 - i)));
+	jw_put(w, (const char*)b, (size_t)bytes + 1);
+}
+
+// comma bookkeeping before any value (or key) at the current depth
+static void jw_before_value(json_writer *w) {
+	if(w->after_key) { w->after_key = false; return; }
+	if(w->format == JW_MSGPACK) {
+		// a map counts its keys, so the value after a key was counted above
+		if(w->depth == 0) w->count++;
+		else mp_count(w, 1);
+		return;
+	}
+	unsigned long long bit = 1ULL << w->depth;
+	if(w->has_items & bit) jw_putc(w, ',');
+	w->has_items |= bit;
+	if(w->depth == 0) w->count++;
+}
+
+static void jw_open(json_writer *w, char c) {
+	jw_before_value(w);
+	if(w->depth == JW_MAX_DEPTH) { w->failed = true; return; }
+	if(w->format == JW_MSGPACK) {
+		if(!w->open_at && !(w->open_at = (size_t*)malloc(JW_MAX_DEPTH * sizeof(size_t)))) { w->failed = true; return; }
+		w->open_at[w->depth] = w->len;
+		mp_tagged(w, c == '{' ? 0xdf : 0xdd, 0, 4);  // map32 / array32, count patched by mp_count
+		w->depth++;
+		return;
+	}
+	jw_putc(w, c);
+	w->depth++;
+	w->has_items &= ~(1ULL << w->depth);
+}
+
+static void jw_close(json_writer *w, char c) {
+	if(w->depth == 0) { w->failed = true; return; }
+	w->depth--;
+	if(w->format == JW_JSON) jw_putc(w, c);
+}
+
+void jw_object_begin(json_writer *w) { jw_open(w, '{'); }
+void jw_object_end(json_writer *w)   { jw_close(w, '}'); }
+void jw_array_begin(json_writer *w)  { jw_open(w, '['); }
+void jw_array_end(json_writer *w)    { jw_close(w, ']'); }
+
+// length of the valid UTF-8 sequence at s (at most n bytes), 0 if invalid
+static size_t utf8_seq_len(const unsigned char *s, size_t n) {
+	unsigned char c = s[0];
+	size_t len;
+	unsigned cp;
+	if(c < 0x80) return 1;
+	if(c >= 0xC2 && c <= 0xDF) { len = 2; cp = c & 0x1F; }
+	else if(c >= 0xE0 && c <= 0xEF) { len = 3; cp = c & 0x0F; }
+	else if(c >= 0xF0 && c <= 0xF4) { len = 4; cp = c & 0x07; }
+	else return 0;
+	if(len > n) return 0;
+	for(size_t i = 1; i < len; i++) {
+		if((s[i] & 0xC0) != 0x80) return 0;
+		cp = (cp << 6) | (s[i] & 0x3F);
+	}
+	if((len == 3 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) || (len == 4 && (cp < 0x10000 || cp > 0x10FFFF)))
+		return 0;
+	return len;
+}
+
+static void jw_escaped(json_writer *w, const char *s, size_t n) {
+	const unsigned char *p = (const unsigned char*)s;
+	jw_putc(w, '"');
+	size_t run = 0; // start of the current run of bytes that need no escaping
+	for(size_t i = 0; i < n; ) {
+		unsigned char c = p[i];
+		const char *esc = NULL;
+		char ubuf[8];
+		size_t seq = 1;
+		switch(c) {
+			case '"':  esc = "\\\""; break;
+			case '\\': esc = "\\\\"; break;
+			case '\b': esc = "\\b"; break;
+			case '\f': esc = "\\f"; break;
+			case '\n': esc = "\\n"; break;
+			case '\r': esc = "\\r"; break;
+			case '\t': esc = "\\t"; break;
+			default:
+				if(c < 0x20) {
+					snprintf(ubuf, sizeof(ubuf), "\\u%04X", c);
+					esc = ubuf;
+				} else if(c >= 0x80) {
+					seq = utf8_seq_len(p + i, n - i);
+					if(seq == 0) { esc = "\xEF\xBF\xBD"; seq = 1; } // U+FFFD for bytes that are not UTF-8
+				}
+		}
+		if(esc) {
+			jw_put(w, s + run, i - run);
+			jw_put(w, esc, strlen(esc));
+			run = i + seq;
+		}
+		i += seq;
+	}
+	jw_put(w, s + run, n - run);
+	jw_putc(w, '"');
+}
+
+// MessagePack str with the same U+FFFD replacement as jw_escaped
+static void mp_str(json_writer *w, const char *s, size_t n) {
+	const unsigned char *p = (const unsigned char*)s;
+	size_t out = 0;
+	for(size_t i = 0; i < n; ) {
+		size_t seq = p[i] < 0x80 ? 1 : utf8_seq_len(p + i, n - i);
+		out += seq ? seq : 3;
+		i += seq ? seq : 1;
+	}
+	if(out < 32) mp_tagged(w, (unsigned char)(0xa0 | out), 0, 0);
+	else if(out <= 0xff) mp_tagged(w, 0xd9, out, 1);
+	else if(out <= 0xffff) mp_tagged(w, 0xda, out, 2);
+	else mp_tagged(w, 0xdb, out, 4);
+	if(out == n) { jw_put(w, s, n); return; }
+	size_t run = 0;
+	for(size_t i = 0; i < n; ) {
+		size_t seq = p[i] < 0x80 ? 1 : utf8_seq_len(p + i, n - i);
+		if(seq == 0) {
+			jw_put(w, s + run, i - run);
+			jw_put(w, "\xEF\xBF\xBD", 3);
+			run = ++i;
+		} else {
+			i += seq;
+		}
+	}
+	jw_put(w, s + run, n - run);
+}
+
+void jw_key(json_writer *w, const char *key) {
+	jw_before_value(w);
+	if(w->format == JW_MSGPACK) {
+		mp_str(w, key, strlen(key));
+	} else {
+		jw_escaped(w, key, strlen(key));
+		jw_putc(w, ':');
+	}
+	w->after_key = true;
+}
+
+void jw_string_n(json_writer *w, const char *s, size_t n) {
+	jw_before_value(w);
+	if(w->format == JW_MSGPACK) mp_str(w, s ? s : "", s ? n : 0);
+	else jw_escaped(w, s ? s : "", s ? n : 0);
+}
+
+void jw_string(json_writer *w, const char *s) { jw_string_n(w, s, s ? strlen(s) : 0); }
+
+static void mp_int(json_writer *w, long long v) {
+	if(v >= 0) {
+		uint64_t u = (uint64_t)v;
+		if(u < 0x80) mp_tagged(w, (unsigned char)u, 0, 0);
+		else if(u <= 0xff) mp_tagged(w, 0xcc, u, 1);
+		else if(u <= 0xffff) mp_tagged(w, 0xcd, u, 2);
+		else if(u <= 0xffffffffu) mp_tagged(w, 0xce, u, 4);
+		else mp_tagged(w, 0xcf, u, 8);
+	} else {
+		uint64_t u = (uint64_t)v;  // two's complement, truncated by mp_tagged
+		if(v >= -32) mp_tagged(w, (unsigned char)u, 0, 0);
+		else if(v >= INT8_MIN) mp_tagged(w, 0xd0, u, 1);
+		else if(v >= INT16_MIN) mp_tagged(w, 0xd1, u, 2);
+		else if(v >= INT32_MIN) mp_tagged(w, 0xd2, u, 4);
+		else mp_tagged(w, 0xd3, u, 8);
+	}
+}
+
+void jw_int(json_writer *w, long long v) {
+	if(w->format == JW_MSGPACK) { jw_before_value(w); mp_int(w, v); return; }
+	char num[24];
+	int n = snprintf(num, sizeof(num), "%lld", v);
+	jw_before_value(w);
+	jw_put(w, num, (size_t)n);
+}
+
+void jw_bool(json_writer *w, bool v) {
+	jw_before_value(w);
+	if(w->format == JW_MSGPACK) mp_tagged(w, v ? 0xc3 : 0xc2, 0, 0);
+	else if(v) jw_put(w, "true", 4);
+	else  jw_put(w, "false", 5);
+}
+
+void jw_raw(json_writer *w, const char *frag, size_t len, size_t count) {
+	if(count == 0 || len == 0) return;
+	jw_before_value(w);
+	jw_put(w, frag, len);
+	if(w->depth == 0) w->count += count - 1;
+	else if(w->format == JW_MSGPACK) mp_count(w, count - 1);
+}
+
+static void jw_null(json_writer *w) {
+	jw_before_value(w);
+	if(w->format == JW_MSGPACK) mp_tagged(w, 0xc0, 0, 0);
+	else jw_put(w, "null", 4);
+}
+
+// doubles as jansson prints them (%.17g, ".0" added to integral values) or float64
+static void jw_real(json_writer *w, double v) {
+	jw_before_value(w);
+	if(w->format == JW_MSGPACK) {
+		uint64_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		mp_tagged(w, 0xcb, bits, 8);
+		return;
+	}
+	char num[40];
+	int n = snprintf(num, sizeof(num), "%.17g", v);
+	if(n > 0 && !strpbrk(num, ".eEn")) { num[n++] = '.'; num[n++] = '0'; }
+	jw_put(w, num, (size_t)n);
+}
+
+void jw_value(json_writer *w, const json_t *v) {
+	const char *key;
+	json_t *item;
+	size_t i;
+	switch(json_typeof(v)) {
+	case JSON_OBJECT:
+		jw_object_begin(w);
+		json_object_foreach((json_t*)v, key, item) {
+			jw_key(w, key);
+			jw_value(w, item);
+		}
+		jw_object_end(w);
+		break;
+	case JSON_ARRAY:
+		jw_array_begin(w);
+		json_array_foreach(v, i, item) jw_value(w, item);
+		jw_array_end(w);
+		break;
+	case JSON_STRING:  jw_string_n(w, json_string_value(v), json_string_length(v)); break;
+	case JSON_INTEGER: jw_int(w, (long long)json_integer_value(v)); break;
+	case JSON_REAL:    jw_real(w, json_real_value(v)); break;
+	case JSON_TRUE:    jw_bool(w, true); break;
+	case JSON_FALSE:   jw_bool(w, false); break;
+	default:           jw_null(w); break;
+	}
+}
+
+
+/* --------------------------- MessagePack reader --------------------------- */
+
+typedef struct {
+	const unsigned char *p, *end;
+	int depth;
+} mp_reader;
+
+static bool mp_be(mp_reader *r, int bytes, uint64_t *out) {
+	if(r->end - r->p < bytes) return false;
+	uint64_t v = 0;
+	for(int i = 0; i < bytes; i++) v = (v << 8) | r->p[i];
+	r->p += bytes;
+	*out = v;
+	return true;
+}
+
+static json_t *mp_read(mp_reader *r);
+
+static json_t *mp_read_str(mp_reader *r, uint64_t n) {
+	if((uint64_t)(r->end - r->p) < n) return NULL;
+	json_t *s = json_stringn((const char*)r->p, (size_t)n);  // NULL for invalid UTF-8
+	r->p += n;
+	return s;
+}
+
+static json_t *mp_read_array(mp_reader *r, uint64_t n) {
+	if(n > (uint64_t)(r->end - r->p)) return NULL;  // every element takes at least one byte
+	json_t *a = json_array();
+	for(uint64_t i = 0; a && i < n; i++) {
+		json_t *v = mp_read(r);
+		if(!v || json_array_append_new(a, v) != 0) { json_decref(a); a = NULL; }
+	}
+	return a;
+}
+
+static json_t *mp_read_map(mp_reader *r, uint64_t n) {
+	if(n > (uint64_t)(r->end - r->p) / 2) return NULL;
+	json_t *o = json_object();
+	for(uint64_t i = 0; o && i < n; i++) {
+		json_t *k = mp_read(r);
+		json_t *v = k && json_is_string(k) ? mp_read(r) : NULL;
+		if(!v || json_object_setn_new(o, json_string_value(k), json_string_length(k), v) != 0) {
+			json_decref(o);
+			o = NULL;
+		}
+		json_decref(k);
+	}
+	return o;
+}
+
+static json_t *mp_read(mp_reader *r) {
+	if(r->p >= r->end || r->depth > JW_MAX_DEPTH) return NULL;
+	unsigned char t = *r->p++;
+	uint64_t v;
+	json_t *out = NULL;
+	r->depth++;
+	if(t < 0x80) out = json_integer(t);
+	else if(t >= 0xe0) out = json_integer((int8_t)t);
+	else if((t & 0xe0) == 0xa0) out = mp_read_str(r, t & 0x1f);
+	else if((t & 0xf0) == 0x90) out = mp_read_array(r, t & 0x0f);
+	else if((t & 0xf0) == 0x80) out = mp_read_map(r, t & 0x0f);
+	else switch(t) {
+	case 0xc0: out = json_null(); break;
+	case 0xc2: out = json_false(); break;
+	case 0xc3: out = json_true(); break;
+	case 0xcc: if(mp_be(r, 1, &v)) out = json_integer((json_int_t)v); break;
+	case 0xcd: if(mp_be(r, 2, &v)) out = json_integer((json_int_t)v); break;
+	case 0xce: if(mp_be(r, 4, &v)) out = json_integer((json_int_t)v); break;
+	case 0xcf: if(mp_be(r, 8, &v) && v <= INT64_MAX) out = json_integer((json_int_t)v); break;
+	case 0xd0: if(mp_be(r, 1, &v)) out = json_integer((int8_t)v); break;
+	case 0xd1: if(mp_be(r, 2, &v)) out = json_integer((int16_t)v); break;
+	case 0xd2: if(mp_be(r, 4, &v)) out = json_integer((int32_t)v); break;
+	case 0xd3: if(mp_be(r, 8, &v)) out = json_integer((json_int_t)(int64_t)v); break;
+	case 0xca: if(mp_be(r, 4, &v)) { uint32_t b = (uint32_t)v; float f; memcpy(&f, &b, sizeof(f)); out = json_real(f); } break;
+	case 0xcb: if(mp_be(r, 8, &v)) { double d; memcpy(&d, &v, sizeof(d)); out = json_real(d); } break;
+	case 0xd9: if(mp_be(r, 1, &v)) out = mp_read_str(r, v); break;
+	case 0xda: if(mp_be(r, 2, &v)) out = mp_read_str(r, v); break;
+	case 0xdb: if(mp_be(r, 4, &v)) out = mp_read_str(r, v); break;
+	case 0xdc: if(mp_be(r, 2, &v)) out = mp_read_array(r, v); break;
+	case 0xdd: if(mp_be(r, 4, &v)) out = mp_read_array(r, v); break;
+	case 0xde: if(mp_be(r, 2, &v)) out = mp_read_map(r, v); break;
+	case 0xdf: if(mp_be(r, 4, &v)) out = mp_read_map(r, v); break;
+	default: break;  // bin, ext and 0xc1 never appear in parse documents
+	}
+	r->depth--;
+	return out;
+}
+
+json_t *json_loadb_msgpack(const char *s, size_t len) {
+	if(!s) return NULL;
+	mp_reader r = { (const unsigned char*)s, (const unsigned char*)s + len, 0 };
+	json_t *v = mp_read(&r);
+	if(v && r.p != r.end) { json_decref(v); v = NULL; }
+	return v;
+}
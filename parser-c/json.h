@@ -1,10 +1,68 @@
 #ifndef JSON_HELPERS_H
 #define JSON_HELPERS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <jansson.h>
 
 json_t *json_loads_safe(const char *s);
+// same for a body of known length (need not be NUL-terminated)
+json_t *json_loadb_safe(const char *s, size_t len);
+// decode one MessagePack value (as produced by the JW_MSGPACK writer) into
+// the equivalent jansson value; NULL if malformed, truncated or followed by extra bytes
+json_t *json_loadb_msgpack(const char *s, size_t len);
 
 const char *json_get_string_else(json_t *obj, const char *key, const char *fallback);
 
+/* --------------------------- streaming writer ---------------------------
+   Append-only JSON emitter into one growable buffer. Commas are inserted
+   automatically; at depth 0 consecutive values form a comma separated
+   list, which is how partial arrays are built and later spliced in with
+   jw_raw(). Strings are escaped the way jansson's json_dumps does. An
+   allocation failure sets `failed` and turns the remaining calls into
+   no-ops.
+
+   The same calls can emit MessagePack instead (jw_init_format): objects
+   become maps and arrays arrays, each with a 32-bit count that is filled
+   in as values are added, so nothing needs to know sizes up front and
+   depth-0 lists splice with jw_raw() exactly like JSON ones. Fragments
+   passed to jw_raw() must be in the writer's format. */
+
+#define JW_MAX_DEPTH 63
+
+typedef enum { JW_JSON = 0, JW_MSGPACK } jw_format;
+
+typedef struct {
+    char    *buf;
+    size_t   len;
+    size_t   cap;
+    size_t   count;      // values written at depth 0
+    bool     failed;
+    bool     after_key;
+    int      depth;
+    unsigned long long has_items;  // bit d: container at depth d already holds a value
+    jw_format format;
+    size_t  *open_at;    // MessagePack: offset of each open container's header
+} json_writer;
+
+void jw_init(json_writer *w);
+void jw_init_format(json_writer *w, jw_format format);
+void jw_free(json_writer *w);
+void jw_reset(json_writer *w);                // empty it but keep the allocation and format
+char *jw_take(json_writer *w, size_t *len);   // NUL-terminated buffer, caller frees; w is reset and owns nothing
+
+void jw_object_begin(json_writer *w);
+void jw_object_end(json_writer *w);
+void jw_array_begin(json_writer *w);
+void jw_array_end(json_writer *w);
+void jw_key(json_writer *w, const char *key);
+void jw_string(json_writer *w, const char *s);
+void jw_string_n(json_writer *w, const char *s, size_t n);
+void jw_int(json_writer *w, long long v);
+void jw_bool(json_writer *w, bool v);
+// a whole jansson value (objects, arrays, strings, numbers, true/false/null)
+void jw_value(json_writer *w, const json_t *v);
+// append `count` already-encoded, comma separated values (e.g. another writer's depth-0 list)
+void jw_raw(json_writer *w, const char *frag, size_t len, size_t count);
+
 #endif
@@ -1,68 +1,657 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <jansson.h>
 
 #include "http.h"   // defines http_request, http_response, http_server + http_* funcs
-#include "json.h"   // json_loads_safe, json_get_string_else
+#include "json.h"   // json_loads_safe, json_get_string_else, json_writer
 #include "parse.h"  // parse_code, parse_result
+#include "cache.h"  // cache_get, cache_put, cache_get_stats
+#include "session.h" // session_put, session_checkout, session_release
+#include "arena.h"  // ts_pool_install
+#include "workpool.h" // workpool_start
+#include "cli.h"    // cli_analyze
+#include "upstream.h" // upstream_post to the analyzer
+#include "solver.h"   // solver_analyze, the built-in analyzer
+#include "metrics.h"  // metrics_observe, metrics_render
+#include "profile.h"  // profile_run for ?profile=1
 
 static int g_port = 7001;
+static int g_threads = 0;   // 0 = one worker per online cpu
+static int g_keepalive_ms = HTTP_DEFAULT_KEEPALIVE_MS;
+static int g_max_requests = 100;
+static int g_max_body_mb = HTTP_DEFAULT_MAX_BODY_BYTES >> 20;
+static int g_parse_timeout_ms = PARSE_DEFAULT_TIMEOUT_US / 1000;
+static int g_request_timeout_ms = 10000;
+static int g_backlog = 0;
+static int g_max_inflight = 0;
+static int g_cache_mb = 64;          // 0 disables the result cache
+static int g_cache_max_entry_kb = 1024;
+static int g_max_sessions = 256;
+static int g_session_ttl_s = 600;
+static int g_ts_pool = 0;           // route tree-sitter allocations through per-thread pools
+static int g_analysis_threads = -1; // work-stealing pool for batches and large files, -1 = one per cpu, 0 = off
+static int g_parallel_min_kb = 64;  // sources at least this big are split across the pool
+static const char *g_analyzer_url = NULL;  // POST /parse?analyze=1 forwards the summary here instead of solver.c
+static int g_analyzer_timeout_ms = 5000;
+static int g_profile = 0;            // --profile: ?profile=1 compiles and runs submissions (profile.h)
+static const char *g_profile_cc = NULL;
+static const char *g_profile_user = NULL;
+static int g_profile_budget_ms = 5000;
+static int g_log_every = 0;        // --log: 0 off, 1 every request, N one in N
+static char **g_analyze_paths = NULL; // --analyze: run offline over these paths instead of serving
+static int g_analyze_count = -1;
 
 /* GET /health */
 static http_response handle_health(http_request *req) {
     (void)req;
-    return http_json(200, "{\"status\":\"ok\"}");
+    return HTTP_JSON_LITERAL(200, "{\"status\":\"ok\"}");
 }
 
-/* POST /parse  { "language":"c", "code":"..."} */
+// the JSON request body, timed as the decode stage; NULL if it is not JSON
+static json_t *decode_body(const http_request *req) {
+    uint64_t t0 = metrics_now_ns();
+    json_t *in = json_loadb_safe(req->body, req->body_len);
+    metrics_observe(METRIC_DECODE, t0);
+    return in;
+}
+
+// the server's parse budget, bounded by the request's deadline
+static parse_options request_parse_options(const http_request *req) {
+    parse_options opts = {0};
+    opts.timeout_us = g_parse_timeout_ms > 0 ? (uint64_t)g_parse_timeout_ms * 1000u : 0;
+    opts.deadline_ns = req->deadline_ns;
+    return opts;
+}
+
+/* {"ast":...,"summary":...} for one source in the given format, from the
+   cache when the same submission was seen before. NULL with *error set
+   when the parser gave up, NULL alone when encoding failed. */
+static char *parse_payload(const char *language, const char *code, size_t code_len, jw_format format,
+                           const parse_options *opts, size_t *len, const char **error) {
+    *error = NULL;
+
+    // each wire format is cached on its own, under the language tagged with the format
+    char tagged[64];
+    const char *cache_language = language;
+    bool cached = cache_enabled();
+    if (cached && format == JW_MSGPACK) {
+        cached = (size_t)snprintf(tagged, sizeof(tagged), "msgpack:%s", language) < sizeof(tagged);
+        cache_language = tagged;
+    }
+    uint64_t key = 0;
+    if (cached) {
+        key = cache_hash(cache_language, code, code_len);
+        char *hit = cache_get(key, cache_language, code, code_len, len);
+        if (hit) return hit;
+    }
+
+    // the parser streams "ast" and "summary" straight into the response body
+    json_writer w;
+    jw_init_format(&w, format);
+    jw_object_begin(&w);
+    parse_result r = parse_code_n(language, code, code_len, opts, &w);
+    if (r.error) {
+        *error = r.error;
+        jw_free(&w);
+        return NULL;
+    }
+    jw_object_end(&w);
+
+    char *payload = jw_take(&w, len);
+    if (payload && cached) cache_put(key, cache_language, code, code_len, payload, *len);
+    return payload;
+}
+
+// copy the members of an encoded object payload into the object open in w
+static void splice_members(json_writer *w, const char *payload, size_t len, jw_format format) {
+    if (format == JW_MSGPACK) {
+        if (len < 5 || (unsigned char)payload[0] != 0xdf) { w->failed = true; return; }
+        const unsigned char *c = (const unsigned char*)payload + 1;
+        size_t pairs = ((size_t)c[0] << 24) | ((size_t)c[1] << 16) | ((size_t)c[2] << 8) | c[3];
+        jw_raw(w, payload + 5, len - 5, pairs);
+    } else if (len > 2) {
+        jw_raw(w, payload + 1, len - 2, 1);  // without the braces
+    }
+}
+
+/* the analyzer service's answer for the forwarded payload, or {"error":...};
+   with empirical set the answer is decoded to add it, otherwise it is
+   spliced as received */
+static void analysis_upstream(json_writer *w, const char *payload, size_t len, jw_format format,
+                              const json_t *empirical) {
+    const char *media = format == JW_MSGPACK ? "application/msgpack" : "application/json";
+    upstream_reply up;
+    upstream_post(payload, len, media, media, &up);
+    bool usable = up.status == 200 && up.body_len > 0 && strcasecmp(up.content_type, media) == 0;
+    json_t *answer = NULL;
+    if (usable && (format == JW_JSON || empirical)) {
+        // never splice a broken document
+        answer = format == JW_MSGPACK ? json_loadb_msgpack(up.body, up.body_len)
+                                      : json_loadb_safe(up.body, up.body_len);
+        usable = answer != NULL && (!empirical || json_is_object(answer));
+    }
+    if (usable && empirical) {
+        json_object_set(answer, "empirical", (json_t*)empirical);
+        jw_value(w, answer);
+    } else if (usable) {
+        jw_raw(w, up.body, up.body_len, 1);
+    } else {
+        char msg[96];
+        if (up.status) snprintf(msg, sizeof(msg), "analyzer answered %d", up.status);
+        jw_object_begin(w);
+        jw_key(w, "error");
+        jw_string(w, up.status ? msg : up.error);
+        if (empirical) { jw_key(w, "empirical"); jw_value(w, empirical); }
+        jw_object_end(w);
+    }
+    json_decref(answer);
+    upstream_reply_free(&up);
+}
+
+// the same answer computed in-process (solver.c), without a round trip
+static void analysis_native(json_writer *w, const char *payload, size_t len, jw_format format,
+                            const json_t *empirical) {
+    json_t *doc = format == JW_MSGPACK ? json_loadb_msgpack(payload, len) : json_loadb_safe(payload, len);
+    json_t *result = solver_analyze(doc);
+    if (empirical) json_object_set(result, "empirical", (json_t*)empirical);
+    jw_value(w, result);
+    json_decref(result);
+    json_decref(doc);
+}
+
+/* The parse payload with the analysis of its summary added as "analysis":
+   by the analyzer service when --analyzer-url is given (the payload is
+   forwarded as is, it reads "summary" and ignores the rest), otherwise by
+   the built-in port of it. A profile (profile.h), when there is one, sits
+   in the analysis as "empirical", next to the static "complexity". */
+static char *attach_analysis(char *payload, size_t *len, jw_format format, const json_t *empirical) {
+    json_writer w;
+    jw_init_format(&w, format);
+    jw_object_begin(&w);
+    splice_members(&w, payload, *len, format);
+    jw_key(&w, "analysis");
+    if (upstream_enabled()) analysis_upstream(&w, payload, *len, format, empirical);
+    else analysis_native(&w, payload, *len, format, empirical);
+    jw_object_end(&w);
+    free(payload);
+    return jw_take(&w, len);
+}
+
+// MessagePack when the client lists it in Accept (application/msgpack or application/x-msgpack)
+static bool wants_msgpack(const http_request *req) {
+    return http_accepts(req, "application/msgpack") || http_accepts(req, "application/x-msgpack");
+}
+
+// a C source sent as the body itself rather than wrapped in JSON
+static bool is_raw_source(const http_request *req) {
+    const char *ct = http_header_get(req, "Content-Type");
+    if (!ct) return false;
+    size_t n = strcspn(ct, "; ");
+    return (n == 10 && strncasecmp(ct, "text/plain", n) == 0) ||
+           (n == 8 && strncasecmp(ct, "text/x-c", n) == 0) ||
+           (n == 11 && strncasecmp(ct, "text/x-csrc", n) == 0);
+}
+
+// ?name=1 and friends: present and neither "0" nor "false"
+static bool query_flag(const http_request *req, const char *name) {
+    char flag[8];
+    return http_query_get(req, name, flag, sizeof(flag)) && strcmp(flag, "0") != 0 && strcmp(flag, "false") != 0;
+}
+
+// the "empirical" profile of one submission; ?entry=name picks the function to run
+static json_t *request_profile(const http_request *req, const char *language, const char *code, size_t len) {
+    if (strcmp(language, "c") != 0) return json_pack("{s:s}", "error", "only C sources can be profiled");
+    char entry[128];
+    bool named = http_query_get(req, "entry", entry, sizeof(entry)) && entry[0];
+    return profile_run(code, len, named ? entry : NULL, req->deadline_ns);
+}
+
+/* POST /parse  { "language":"c", "code":"..."}
+   or the C source itself with Content-Type text/plain (or text/x-c),
+   which is parsed straight from the request body without a decoded copy.
+   Answers with the same document as MessagePack when the client accepts
+   application/msgpack; errors are always JSON. With ?analyze=1 the
+   summary is also analyzed (in-process, or by --analyzer-url) and the
+   result added as "analysis"; ?profile=1 implies it and adds a measured
+   profile of the compiled source (--profile only, see profile.h). */
 static http_response handle_parse(http_request *req) {
-    json_t *in = json_loads_safe(req->body);
-    if (!in) return http_json(400, "{\"error\":\"invalid JSON\"}");
+    const char *error = NULL;
+    size_t payload_len = 0;
+    char *payload;
+    jw_format format = wants_msgpack(req) ? JW_MSGPACK : JW_JSON;
+    parse_options opts = request_parse_options(req);
+    json_t *in = NULL;  // kept until the end: code points into it
+    const char *language = "c", *code = "";
+    size_t code_len = 0;
+    if (is_raw_source(req)) {
+        if (req->body) code = req->body;
+        code_len = req->body_len;
+    } else {
+        in = decode_body(req);
+        if (!in) return HTTP_JSON_LITERAL(400, "{\"error\":\"invalid JSON\"}");
 
-    const char *language = json_get_string_else(in, "language", "c");
-    const char *code     = json_get_string_else(in, "code", "");
+        language = json_get_string_else(in, "language", "c");
+        json_t *c = json_object_get(in, "code");
+        if (json_is_string(c)) {
+            code = json_string_value(c);
+            code_len = json_string_length(c);
+        }
+    }
+    payload = parse_payload(language, code, code_len, format, &opts, &payload_len, &error);
 
-    parse_result r = parse_code(language, code);
+    if (error) {
+        json_decref(in);
+        char msg[96];
+        snprintf(msg, sizeof(msg), "{\"error\":\"%s\"}", error);
+        return http_json(503, msg);
+    }
+    bool profile = query_flag(req, "profile");
+    if (payload && (profile || query_flag(req, "analyze"))) {
+        json_t *empirical = profile ? request_profile(req, language, code, code_len) : NULL;
+        payload = attach_analysis(payload, &payload_len, format, empirical);
+        json_decref(empirical);
+    }
+    json_decref(in);
+    if (!payload) return HTTP_JSON_LITERAL(500, "{\"error\":\"json encode failed\"}");
+    http_response res = http_json_take(200, payload, payload_len);
+    if (format == JW_MSGPACK) res.content_type = "application/msgpack";
+    return res;
+}
 
-    json_t *out = json_object();
-    json_object_set_new(out, "ast",     r.ast_json);     // ownership transferred
-    json_object_set_new(out, "summary", r.summary_json); // ownership transferred
+/* POST /parse/batch
+     [ {"id":..., "language":"c", "code":"..."}, ... ]
+     or { "items":[...], "format":"ndjson"|"json" }
+   Items are parsed on the analysis pool and each result is sent as soon as
+   it is ready, so results arrive in completion order, not input order:
+   one {"id":...,"ast":...,"summary":...} (or {"id":...,"error":"..."})
+   per line as application/x-ndjson, or the same objects as one JSON array
+   when "format" is "json" or the client only accepts application/json.
+   "id" is echoed back as given, defaulting to the item's index. */
+typedef struct {
+    json_t *items;
+    http_request *req;
+    bool as_array;
+    pthread_mutex_t mu;    // serializes writes to the stream
+    size_t sent;
+    bool failed;           // client went away: skip the remaining items
+} batch_ctx;
+
+static void batch_send(batch_ctx *B, json_writer *w) {
+    if (w->failed) {
+        jw_reset(w);
+        jw_object_begin(w);
+        jw_key(w, "error");
+        jw_string(w, "json encode failed");
+        jw_object_end(w);
+    }
+    pthread_mutex_lock(&B->mu);
+    if (!B->failed) {
+        const char *sep = B->as_array ? (B->sent ? "," : "[") : NULL;
+        if ((sep && http_stream_write(B->req, sep, 1) < 0) ||
+            http_stream_write(B->req, w->buf, w->len) < 0 ||
+            (!B->as_array && http_stream_write(B->req, "\n", 1) < 0)) B->failed = true;
+        B->sent++;
+    }
+    pthread_mutex_unlock(&B->mu);
+}
+
+static void batch_task(void *ctx, size_t index) {
+    batch_ctx *B = (batch_ctx*)ctx;
+    pthread_mutex_lock(&B->mu);
+    bool skip = B->failed;
+    pthread_mutex_unlock(&B->mu);
+    if (skip) return;
+
+    json_t *item = json_array_get(B->items, index);
+    json_t *id = json_is_object(item) ? json_object_get(item, "id") : NULL;
+    json_t *code = json_is_object(item) ? json_object_get(item, "code") : NULL;
+    const char *language = json_is_object(item) ? json_get_string_else(item, "language", "c") : "c";
+
+    json_writer w;
+    jw_init(&w);
+    jw_object_begin(&w);
+    jw_key(&w, "id");
+    char *id_text = id ? json_dumps(id, JSON_COMPACT | JSON_ENCODE_ANY) : NULL;
+    if (id_text) jw_raw(&w, id_text, strlen(id_text), 1);
+    else jw_int(&w, (long long)index);
+    free(id_text);
+
+    if (!json_is_string(code)) {
+        jw_key(&w, "error");
+        jw_string(&w, "expected {id, language, code}");
+    } else {
+        const char *error = NULL;
+        size_t len = 0;
+        parse_options opts = request_parse_options(B->req);
+        char *payload = parse_payload(language, json_string_value(code), json_string_length(code), JW_JSON,
+                                      &opts, &len, &error);
+        if (payload) {
+            splice_members(&w, payload, len, JW_JSON);
+        } else {
+            jw_key(&w, "error");
+            jw_string(&w, error ? error : "json encode failed");
+        }
+        free(payload);
+    }
+    jw_object_end(&w);
+    batch_send(B, &w);
+    jw_free(&w);
+}
 
+static http_response handle_parse_batch(http_request *req) {
+    json_t *in = decode_body(req);
+    if (!in) return HTTP_JSON_LITERAL(400, "{\"error\":\"invalid JSON\"}");
+
+    json_t *items = json_is_array(in) ? in : json_object_get(in, "items");
+    if (!json_is_array(items)) {
+        json_decref(in);
+        return HTTP_JSON_LITERAL(400, "{\"error\":\"expected an array of {id, language, code}\"}");
+    }
+    const char *format = json_is_object(in) ? json_get_string_else(in, "format", NULL) : NULL;
+    bool as_array = format ? strcmp(format, "json") == 0
+                           : http_accepts(req, "application/json") && !http_accepts(req, "application/x-ndjson");
+
+    batch_ctx B = { .items = items, .req = req, .as_array = as_array };
+    pthread_mutex_init(&B.mu, NULL);
+    if (http_stream_begin(req, 200, as_array ? "application/json" : "application/x-ndjson") < 0) {
+        B.failed = true;
+    } else {
+        workpool_run(json_array_size(items), batch_task, &B);
+        if (as_array && !B.failed) http_stream_write(req, B.sent ? "]" : "[]", B.sent ? 1 : 2);
+    }
+    pthread_mutex_destroy(&B.mu);
+    json_decref(in);
+    return http_streamed();
+}
+
+static http_response json_reply(int status, json_t *out) {
     char *payload = json_dumps(out, JSON_COMPACT);
     json_decref(out);
-    json_decref(in);
+    if (!payload) return HTTP_JSON_LITERAL(500, "{\"error\":\"json encode failed\"}");
+    return http_json_take(status, payload, strlen(payload));
+}
+
+// hands the writer's buffer to the response without copying it
+static http_response writer_reply(int status, json_writer *w) {
+    size_t len = 0;
+    char *payload = jw_take(w, &len);
+    if (!payload) return HTTP_JSON_LITERAL(500, "{\"error\":\"json encode failed\"}");
+    return http_json_take(status, payload, len);
+}
+
+static http_response json_error(int status, const char *msg) {
+    json_t *out = json_object();
+    json_object_set_new(out, "error", json_string(msg));
+    return json_reply(status, out);
+}
+
+/* POST /parse/edit
+     open:  { "session":"id"?, "language":"c", "code":"..." }
+     edit:  { "session":"id", "edits":[ {"start":s, "end":e, "text":"..."}, ... ] }
+   start/end are byte offsets into the session's current source; edits are
+   applied in order. Both answer like /parse plus "session" and
+   "incremental" counters. */
+static http_response handle_parse_edit(http_request *req) {
+    json_t *in = decode_body(req);
+    if (!in) return HTTP_JSON_LITERAL(400, "{\"error\":\"invalid JSON\"}");
+
+    char id[SESSION_ID_MAX + 1];
+    const char *given = json_get_string_else(in, "session", NULL);
+    if (given && !session_id_valid(given)) {
+        json_decref(in);
+        return HTTP_JSON_LITERAL(400, "{\"error\":\"invalid session id\"}");
+    }
+    if (given) snprintf(id, sizeof(id), "%s", given);
+    else session_new_id(id);
 
-    http_response resp;
-    if (!payload) {
-        resp = http_json(500, "{\"error\":\"json encode failed\"}");
+    json_t *code = json_object_get(in, "code");
+    json_t *edits = json_object_get(in, "edits");
+    parse_options opts = request_parse_options(req);
+    parse_result r = {0};
+    parse_doc_stats st = {0};
+    parse_status ps;
+    json_writer w;
+    jw_init(&w);
+    jw_object_begin(&w);
+    jw_key(&w, "session");
+    jw_string(&w, id);
+
+    if (json_is_string(code)) {
+        const char *language = json_get_string_else(in, "language", "c");
+        parse_doc *doc = NULL;
+        ps = parse_doc_open(language, json_string_value(code), json_string_length(code), &opts, &doc, &w, &r, &st);
+        if (ps == PARSE_OK && session_put(id, doc) != SESSION_OK) {
+            parse_doc_free(doc);
+            jw_free(&w);
+            json_decref(in);
+            return HTTP_JSON_LITERAL(409, "{\"error\":\"session busy\"}");
+        }
+    } else if (given && json_is_array(edits)) {
+        size_t n = json_array_size(edits);
+        parse_edit *list = (parse_edit*)calloc(n ? n : 1, sizeof(parse_edit));
+        bool ok = list != NULL;
+        for (size_t i = 0; ok && i < n; i++) {
+            json_t *e = json_array_get(edits, i);
+            json_t *s = json_object_get(e, "start");
+            json_t *t = json_object_get(e, "end");
+            json_t *x = json_object_get(e, "text");
+            ok = json_is_integer(s) && json_is_integer(t) && (!x || json_is_string(x)) &&
+                 json_integer_value(s) >= 0 && json_integer_value(t) >= 0 &&
+                 json_integer_value(s) <= UINT32_MAX && json_integer_value(t) <= UINT32_MAX;
+            if (!ok) break;
+            list[i].start = (uint32_t)json_integer_value(s);
+            list[i].end = (uint32_t)json_integer_value(t);
+            list[i].text = x ? json_string_value(x) : "";
+            list[i].text_len = x ? json_string_length(x) : 0;
+        }
+        if (!ok) {
+            free(list);
+            jw_free(&w);
+            json_decref(in);
+            return HTTP_JSON_LITERAL(400, "{\"error\":\"edits must be [{start,end,text}]\"}");
+        }
+
+        parse_doc *doc = NULL;
+        session_status ss = session_checkout(id, &doc);
+        if (ss != SESSION_OK) {
+            free(list);
+            jw_free(&w);
+            json_decref(in);
+            return ss == SESSION_BUSY ? HTTP_JSON_LITERAL(409, "{\"error\":\"session busy\"}")
+                                      : HTTP_JSON_LITERAL(404, "{\"error\":\"unknown session\"}");
+        }
+        ps = parse_doc_edit(doc, list, n, &opts, &w, &r, &st);
+        if (ps == PARSE_HALTED) session_drop(id);
+        else session_release(id);
+        free(list);
     } else {
-        resp = http_json(200, payload);
-        free(payload);
+        jw_free(&w);
+        json_decref(in);
+        return HTTP_JSON_LITERAL(400, "{\"error\":\"expected code or session+edits\"}");
+    }
+    json_decref(in);
+
+    if (ps != PARSE_OK) {
+        jw_free(&w);
+        return json_error(ps == PARSE_BAD_INPUT ? 400 : 503, r.error ? r.error : "parse failed");
     }
-    return resp;
+
+    jw_key(&w, "incremental");
+    jw_object_begin(&w);
+    jw_key(&w, "reanalyzed"); jw_int(&w, (long long)st.reanalyzed);
+    jw_key(&w, "reused"); jw_int(&w, (long long)st.reused);
+    jw_object_end(&w);
+    jw_object_end(&w);
+    return writer_reply(200, &w);
 }
 
-/* parse CLI args like: --port 7001 */
+/* DELETE /parse/edit/:session  ends an edit session and frees its document */
+static http_response handle_parse_edit_close(http_request *req) {
+    char id[SESSION_ID_MAX + 2];  // one extra byte so an over-long id is not truncated into a valid one
+    if (!http_param_get(req, "session", id, sizeof(id)) || !session_id_valid(id))
+        return HTTP_JSON_LITERAL(400, "{\"error\":\"invalid session id\"}");
+    parse_doc *doc = NULL;
+    session_status ss = session_checkout(id, &doc);
+    if (ss != SESSION_OK) {
+        return ss == SESSION_BUSY ? HTTP_JSON_LITERAL(409, "{\"error\":\"session busy\"}")
+                                  : HTTP_JSON_LITERAL(404, "{\"error\":\"unknown session\"}");
+    }
+    session_drop(id);
+    return HTTP_JSON_LITERAL(200, "{\"closed\":true}");
+}
+
+/* GET /stats */
+static http_response handle_stats(http_request *req) {
+    (void)req;
+    cache_stats st = cache_get_stats();
+    uint64_t lookups = st.hits + st.misses;
+
+    json_t *cache = json_object();
+    json_object_set_new(cache, "enabled", json_boolean(st.capacity > 0));
+    json_object_set_new(cache, "hits", json_integer((json_int_t)st.hits));
+    json_object_set_new(cache, "misses", json_integer((json_int_t)st.misses));
+    json_object_set_new(cache, "hitRatio", json_real(lookups ? (double)st.hits / (double)lookups : 0.0));
+    json_object_set_new(cache, "inserts", json_integer((json_int_t)st.inserts));
+    json_object_set_new(cache, "evictions", json_integer((json_int_t)st.evictions));
+    json_object_set_new(cache, "entries", json_integer((json_int_t)st.entries));
+    json_object_set_new(cache, "bytes", json_integer((json_int_t)st.bytes));
+    json_object_set_new(cache, "capacityBytes", json_integer((json_int_t)st.capacity));
+
+    json_t *out = json_object();
+    json_object_set_new(out, "cache", cache);
+    return json_reply(200, out);
+}
+
+/* GET /metrics  (Prometheus text format) */
+static http_response handle_metrics(http_request *req) {
+    (void)req;
+    size_t len = 0;
+    char *text = metrics_render(&len);
+    if (!text) return HTTP_JSON_LITERAL(500, "{\"error\":\"out of memory\"}");
+    http_response res = http_json_take(200, text, len);
+    res.content_type = "text/plain; version=0.0.4; charset=utf-8";
+    return res;
+}
+
+/* parse CLI args like: --port 7001 --threads 4 --keepalive-timeout 5000 --max-requests 100
+   --max-body-mb 16 --parse-timeout 2000 --request-timeout 10000 --cache-mb 64 --cache-max-entry-kb 1024
+   --backlog 128 --max-inflight 64 --max-sessions 256 --session-ttl 600 --analyzer-url http://analyzer:7100/analyze --analyzer-timeout 5000
+   --log off|all|sample=N --profile --profile-cc "gcc" --profile-user nobody --profile-budget-ms 5000
+   Everything after --analyze is a path to analyze offline (see cli.h). */
 static void parse_args(int argc, char **argv) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
             g_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            g_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--keepalive-timeout") == 0 && i + 1 < argc) {
+            g_keepalive_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-requests") == 0 && i + 1 < argc) {
+            g_max_requests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-body-mb") == 0 && i + 1 < argc) {
+            g_max_body_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--parse-timeout") == 0 && i + 1 < argc) {
+            g_parse_timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--request-timeout") == 0 && i + 1 < argc) {
+            g_request_timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--backlog") == 0 && i + 1 < argc) {
+            g_backlog = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-inflight") == 0 && i + 1 < argc) {
+            g_max_inflight = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+            g_cache_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache-max-entry-kb") == 0 && i + 1 < argc) {
+            g_cache_max_entry_kb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-sessions") == 0 && i + 1 < argc) {
+            g_max_sessions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--session-ttl") == 0 && i + 1 < argc) {
+            g_session_ttl_s = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ts-pool") == 0) {
+            g_ts_pool = 1;
+        } else if (strcmp(argv[i], "--analysis-threads") == 0 && i + 1 < argc) {
+            g_analysis_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--parallel-min-kb") == 0 && i + 1 < argc) {
+            g_parallel_min_kb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--analyzer-url") == 0 && i + 1 < argc) {
+            g_analyzer_url = argv[++i];
+        } else if (strcmp(argv[i], "--analyzer-timeout") == 0 && i + 1 < argc) {
+            g_analyzer_timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            g_profile = 1;
+        } else if (strcmp(argv[i], "--profile-cc") == 0 && i + 1 < argc) {
+            g_profile_cc = argv[++i];
+        } else if (strcmp(argv[i], "--profile-user") == 0 && i + 1 < argc) {
+            g_profile_user = argv[++i];
+        } else if (strcmp(argv[i], "--profile-budget-ms") == 0 && i + 1 < argc) {
+            g_profile_budget_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "all") == 0) g_log_every = 1;
+            else if (strncmp(mode, "sample=", 7) == 0 && atoi(mode + 7) > 0) g_log_every = atoi(mode + 7);
+            else g_log_every = 0;  // "off"
+        } else if (strcmp(argv[i], "--analyze") == 0) {
+            g_analyze_paths = argv + i + 1;
+            g_analyze_count = argc - i - 1;
+            break;
         }
     }
 }
 
+static int default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
 int main(int argc, char **argv) {
     parse_args(argc, argv);
+    if (g_ts_pool) ts_pool_install();  // before any parser or tree exists
+    parse_set_timeout_micros(g_parse_timeout_ms > 0 ? (uint64_t)g_parse_timeout_ms * 1000u : 0);
+    parse_init();  // every grammar's node table, before the first request
+    int analysis_threads = g_analysis_threads >= 0 ? g_analysis_threads : default_threads();
+    if (analysis_threads > 0 && workpool_start((size_t)analysis_threads) == 0) {
+        parse_set_parallel_min_bytes(g_parallel_min_kb > 0 ? (size_t)g_parallel_min_kb << 10 : 1);
+    }
+    if (g_analyze_count >= 0) return cli_analyze(g_analyze_paths, (size_t)g_analyze_count);
 
-    http_server srv = http_listen(g_port);
+    http_server srv = http_listen(g_port, g_backlog);
     if (srv.server_fd < 0) {
         fprintf(stderr, "Failed to bind to port %d\n", g_port);
         return 1;
     }
 
+    srv.threads = g_threads > 0 ? g_threads : default_threads();
+    if (g_profile && g_threads <= 0 && srv.threads < 2) srv.threads = 2;  // a profile never takes the last worker
+    srv.keepalive_timeout_ms = g_keepalive_ms;
+    srv.max_requests = g_max_requests;
+    srv.request_timeout_ms = g_request_timeout_ms;
+    srv.max_inflight = g_max_inflight;
+    srv.max_body_bytes = g_max_body_mb > 0 ? (size_t)g_max_body_mb << 20 : 0;
+    srv.log_every = g_log_every;
+    cache_init(g_cache_mb > 0 ? (size_t)g_cache_mb << 20 : 0,
+               g_cache_max_entry_kb > 0 ? (size_t)g_cache_max_entry_kb << 10 : 0);
+    session_init(g_max_sessions > 0 ? (size_t)g_max_sessions : 0, g_session_ttl_s);
+    if (g_analyzer_url && upstream_init(g_analyzer_url, g_analyzer_timeout_ms) < 0) {
+        fprintf(stderr, "Unusable --analyzer-url %s (expected http://host[:port]/path)\n", g_analyzer_url);
+        return 1;
+    }
+    const char *profile_error = NULL;
+    if (g_profile && profile_init(g_profile_cc, g_profile_user, g_profile_budget_ms, srv.threads, &profile_error) < 0) {
+        fprintf(stderr, "--profile: %s\n", profile_error);
+        return 1;
+    }
+    if (g_profile) srv.costly_query = "profile";  // compiles and runs for seconds, whatever the body size
+
     http_route("GET",  "/health", handle_health);
     http_route("POST", "/parse",  handle_parse);
+    http_route("POST", "/parse/edit", handle_parse_edit);
+    http_route("DELETE", "/parse/edit/:session", handle_parse_edit_close);
+    http_route("POST", "/parse/batch", handle_parse_batch);
+    http_route("GET",  "/stats",  handle_stats);
+    http_route("GET",  "/metrics", handle_metrics);
 
     http_serve(&srv);
     http_close(&srv);
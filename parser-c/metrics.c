@@ -0,0 +1,146 @@
+#include "metrics.h"
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// histogram bucket upper bounds in nanoseconds (+Inf is implicit)
+static const uint64_t BUCKET_NS[] = {
+    10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 50000000,
+    100000000, 250000000, 500000000, 1000000000, 2500000000u, 10000000000u,
+};
+#define NBUCKETS (sizeof(BUCKET_NS) / sizeof(BUCKET_NS[0]))
+
+static const char *const STAGE_NAMES[METRIC_STAGES] = {
+    "queue_wait", "header_read", "body_read", "decode", "parse", "walk", "write", "profile",
+};
+
+typedef struct {
+    atomic_uint_fast64_t buckets[NBUCKETS + 1];  // not cumulative; the last one is +Inf
+    atomic_uint_fast64_t sum_ns;
+    atomic_uint_fast64_t count;
+} histogram;
+
+static struct {
+    histogram stages[METRIC_STAGES];
+    atomic_uint_fast64_t responses[6];  // by status class, [0] for anything outside 1xx..5xx
+    atomic_uint_fast64_t rejected;
+    atomic_uint_fast64_t bytes_in, bytes_out;
+    atomic_int connections, in_flight;
+} M;
+
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_observe(metric_stage stage, uint64_t start_ns) {
+    if ((unsigned)stage >= METRIC_STAGES) return;
+    uint64_t ns = metrics_now_ns() - start_ns;
+    histogram *h = &M.stages[stage];
+    size_t b = 0;
+    while (b < NBUCKETS && ns > BUCKET_NS[b]) b++;
+    atomic_fetch_add_explicit(&h->buckets[b], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+}
+
+void metrics_response(int status) {
+    int cls = status / 100;
+    atomic_fetch_add_explicit(&M.responses[cls >= 1 && cls <= 5 ? cls : 0], 1, memory_order_relaxed);
+}
+
+void metrics_rejected(void) { atomic_fetch_add_explicit(&M.rejected, 1, memory_order_relaxed); }
+
+void metrics_bytes_in(size_t n)  { atomic_fetch_add_explicit(&M.bytes_in, n, memory_order_relaxed); }
+void metrics_bytes_out(size_t n) { atomic_fetch_add_explicit(&M.bytes_out, n, memory_order_relaxed); }
+void metrics_connections(int delta) { atomic_fetch_add_explicit(&M.connections, delta, memory_order_relaxed); }
+void metrics_in_flight(int delta)   { atomic_fetch_add_explicit(&M.in_flight, delta, memory_order_relaxed); }
+
+/* --------------------------- text format --------------------------- */
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    bool failed;
+} text_buf;
+
+static void emit(text_buf *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void emit(text_buf *t, const char *fmt, ...) {
+    if (t->failed) return;
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(t->buf ? t->buf + t->len : NULL, t->cap - t->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) { t->failed = true; return; }
+        if ((size_t)n < t->cap - t->len) { t->len += (size_t)n; return; }
+        size_t ncap = t->cap ? t->cap * 2 : 8192;
+        while (ncap - t->len <= (size_t)n) ncap *= 2;
+        char *p = (char*)realloc(t->buf, ncap);
+        if (!p) { t->failed = true; return; }
+        t->buf = p;
+        t->cap = ncap;
+    }
+}
+
+static void emit_metric(text_buf *t, const char *name, const char *type, const char *help,
+                        unsigned long long value) {
+    emit(t, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n", name, help, name, type, name, value);
+}
+
+static uint64_t load(atomic_uint_fast64_t *v) { return atomic_load_explicit(v, memory_order_relaxed); }
+
+char *metrics_render(size_t *len) {
+    text_buf t = {0};
+
+    emit(&t, "# HELP bigo_stage_seconds Time spent in each stage of request handling.\n"
+             "# TYPE bigo_stage_seconds histogram\n");
+    for (int s = 0; s < METRIC_STAGES; s++) {
+        histogram *h = &M.stages[s];
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < NBUCKETS; b++) {
+            cumulative += load(&h->buckets[b]);
+            emit(&t, "bigo_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                 STAGE_NAMES[s], (double)BUCKET_NS[b] / 1e9, (unsigned long long)cumulative);
+        }
+        cumulative += load(&h->buckets[NBUCKETS]);
+        emit(&t, "bigo_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+             STAGE_NAMES[s], (unsigned long long)cumulative);
+        emit(&t, "bigo_stage_seconds_sum{stage=\"%s\"} %.9f\n", STAGE_NAMES[s], (double)load(&h->sum_ns) / 1e9);
+        emit(&t, "bigo_stage_seconds_count{stage=\"%s\"} %llu\n", STAGE_NAMES[s], (unsigned long long)load(&h->count));
+    }
+
+    emit(&t, "# HELP bigo_http_responses_total Responses sent, by status class.\n"
+             "# TYPE bigo_http_responses_total counter\n");
+    static const char *const classes[6] = { "other", "1xx", "2xx", "3xx", "4xx", "5xx" };
+    for (int c = 0; c < 6; c++) {
+        emit(&t, "bigo_http_responses_total{code=\"%s\"} %llu\n", classes[c], (unsigned long long)load(&M.responses[c]));
+    }
+    emit_metric(&t, "bigo_http_rejected_total", "counter", "Requests answered 503 because --max-inflight was reached.",
+                load(&M.rejected));
+    emit_metric(&t, "bigo_http_received_bytes_total", "counter", "Bytes read from client connections.", load(&M.bytes_in));
+    emit_metric(&t, "bigo_http_sent_bytes_total", "counter", "Bytes written to client connections.", load(&M.bytes_out));
+    emit_metric(&t, "bigo_http_connections", "gauge", "Open client connections, busy or idle.",
+                (unsigned long long)atomic_load_explicit(&M.connections, memory_order_relaxed));
+    emit_metric(&t, "bigo_http_requests_in_flight", "gauge", "Requests being read, handled or answered.",
+                (unsigned long long)atomic_load_explicit(&M.in_flight, memory_order_relaxed));
+
+    cache_stats cs = cache_get_stats();
+    emit_metric(&t, "bigo_cache_hits_total", "counter", "Result cache lookups that found an entry.", cs.hits);
+    emit_metric(&t, "bigo_cache_misses_total", "counter", "Result cache lookups that found nothing.", cs.misses);
+    emit_metric(&t, "bigo_cache_inserts_total", "counter", "Payloads stored in the result cache.", cs.inserts);
+    emit_metric(&t, "bigo_cache_evictions_total", "counter", "Entries evicted to make room.", cs.evictions);
+    emit_metric(&t, "bigo_cache_entries", "gauge", "Entries in the result cache.", cs.entries);
+    emit_metric(&t, "bigo_cache_bytes", "gauge", "Bytes held by the result cache.", cs.bytes);
+    emit_metric(&t, "bigo_cache_capacity_bytes", "gauge", "Result cache capacity, 0 when disabled.", cs.capacity);
+
+    if (t.failed) { free(t.buf); return NULL; }
+    *len = t.len;
+    return t.buf;
+}
@@ -0,0 +1,38 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Process-wide counters and per-stage latency histograms, exported in the
+   Prometheus text format by GET /metrics. Every update is one relaxed
+   atomic add, so recording from the request path costs about as much as
+   reading the clock. */
+
+typedef enum {
+    METRIC_QUEUE_WAIT,   // readable connection waiting for a worker
+    METRIC_HEADER_READ,  // request line and headers off the socket
+    METRIC_BODY_READ,    // request body off the socket
+    METRIC_DECODE,       // JSON request body -> jansson
+    METRIC_PARSE,        // ts_parser_parse_string
+    METRIC_WALK,         // traverse_collect and the summary it writes
+    METRIC_WRITE,        // response onto the socket
+    METRIC_PROFILE,      // instrument, compile and run for ?profile=1
+    METRIC_STAGES
+} metric_stage;
+
+uint64_t metrics_now_ns(void);
+// record the time since start_ns (from metrics_now_ns) for one stage
+void metrics_observe(metric_stage stage, uint64_t start_ns);
+
+void metrics_response(int status);            // one response sent, by status class
+void metrics_rejected(void);                  // one request shed by admission control
+void metrics_bytes_in(size_t n);
+void metrics_bytes_out(size_t n);
+void metrics_connections(int delta);          // open client connections
+void metrics_in_flight(int delta);            // requests between head read and response
+
+// everything recorded so far plus the result cache stats; malloc'd, caller frees
+char *metrics_render(size_t *len);
+
+#endif
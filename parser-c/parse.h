@@ -1,15 +1,92 @@
 #ifndef PARSE_H
 #define PARSE_H
 
-#include <jansson.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "json.h"
+
+#define PARSE_DEFAULT_TIMEOUT_US 2000000u   // 2 s
 
 typedef struct {
-    json_t *ast_json;
-    json_t *summary_json;
+    const char *error;    // static message when the parse was halted, else NULL
 } parse_result;
 
-parse_result parse_code(const char *language, const char *code);
-void free_parse_result(parse_result *r);
+typedef struct {
+    uint64_t timeout_us;        // tree-sitter parse budget, 0 = unlimited
+    const size_t *cancel_flag;  // parse stops once *cancel_flag != 0 (may be NULL)
+    uint64_t deadline_ns;       // metrics_now_ns() time by which parse and walk give up, 0 = none
+} parse_options;
+
+/* Languages are named as requests spell them: "c", and "cpp" when the
+   parser is built with tree-sitter-cpp (PARSE_HAVE_CPP). Every grammar's
+   node table is built once, by parse_init(); the first parse calls it,
+   a server calls it at startup so no request pays for it. */
+void parse_init(void);
+// the language a file's extension implies (.c; .cc, .cpp, .cxx, .c++) if it is supported, else NULL
+const char *parse_language_for_path(const char *path);
+
+/* On success the "ast" and "summary" members are appended to the object
+   currently open in `out`, in out's format (JSON or MessagePack); nothing
+   is written when r.error is set ("deadline exceeded" once opts->deadline_ns
+   has passed, whether during the parse or the walk). A language that is
+   not supported gets an empty summary. */
+parse_result parse_code(const char *language, const char *code, json_writer *out);
+parse_result parse_code_opts(const char *language, const char *code, const parse_options *opts,
+                             json_writer *out);
+// `code` need not be NUL-terminated (e.g. a memory-mapped file)
+parse_result parse_code_n(const char *language, const char *code, size_t len, const parse_options *opts,
+                          json_writer *out);
+
+// default budget for parse_code() and the per-thread parsers it reuses
+void parse_set_timeout_micros(uint64_t timeout_us);
+
+/* Sources of at least min_bytes have their top-level nodes analyzed in
+   parallel on the work pool (see workpool.h); the output is the same as a
+   sequential walk. 0, the default, keeps every walk on the calling thread. */
+void parse_set_parallel_min_bytes(size_t min_bytes);
+
+/* Incremental documents: keep the tree and per-top-level-node analysis of
+   a source so later edits only re-walk what changed. A parse_doc must not
+   be used by two threads at once. */
+
+typedef enum { PARSE_OK = 0, PARSE_BAD_INPUT, PARSE_HALTED } parse_status;
+
+typedef struct {
+    uint32_t start;    // byte range [start, end) of the current source to replace
+    uint32_t end;
+    const char *text;  // replacement bytes
+    size_t text_len;
+} parse_edit;
+
+typedef struct {
+    size_t reanalyzed;  // top-level nodes walked again
+    size_t reused;      // top-level nodes whose cached analysis was kept
+} parse_doc_stats;
+
+typedef struct parse_doc parse_doc;
+
+// both write "ast" and "summary" into w like parse_code() on PARSE_OK; w must be JW_JSON
+parse_status parse_doc_open(const char *language, const char *code, size_t len,
+                            const parse_options *opts, parse_doc **out_doc,
+                            json_writer *w, parse_result *out, parse_doc_stats *st);
+// on PARSE_HALTED the document is unusable and should be freed
+parse_status parse_doc_edit(parse_doc *doc, const parse_edit *edits, size_t nedits,
+                            const parse_options *opts, json_writer *w, parse_result *out,
+                            parse_doc_stats *st);
+void parse_doc_free(parse_doc *doc);
+
+/* For the profiler (profile.h): `code` rewritten so every loop body and
+   every call inside a function bumps a counter, followed by a main() that
+   calls one function with inputs of size argv[1] (pointer parameters get
+   a zeroed buffer of that many elements, the size parameter n, the rest
+   zero) and reports the count on fd 3. entry names the function; NULL
+   picks one (see instrument_entry in parse.c), its name is copied into
+   entry_out. A source that #includes an absolute or ".." path, or a
+   computed name, is refused. Returns the malloc'd, NUL-terminated source,
+   or NULL with *error set to a static message. */
+char *parse_instrument(const char *code, size_t len, const char *entry, const parse_options *opts,
+                       char *entry_out, size_t entry_size, size_t *out_len, const char **error);
 
 #endif
 
@@ -0,0 +1,603 @@
+#include "profile.h"
+#include "parse.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <grp.h>
+#include <pwd.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define PROFILE_DEFAULT_BUDGET_MS 5000
+#define PROFILE_MAX_CC_ARGS   16
+#define PROFILE_MAX_RUNNING   4                 // profiles at once (and below the HTTP workers); more are turned away
+#define PROFILE_MAX_OPS       100000000ull      // a run stops once it has counted this many
+#define PROFILE_MAX_N         (1L << 20)
+#define PROFILE_MAX_SAMPLES   64
+#define PROFILE_MEM_BYTES     (512ul << 20)     // address space of one run
+#define PROFILE_CC_MEM_BYTES  (1ul << 30)       // address space of the compiler and each tool it starts
+#define PROFILE_CC_FILE_BYTES (64ul << 20)      // largest file the compiler may write
+#define PROFILE_LOG_BYTES     2048              // compiler output kept for the server's log
+#define PROFILE_DEFAULT_USER  "nobody"          // children run as this user
+#define PROFILE_MAX_FILTER    128               // instructions in the syscall filter
+#define PROFILE_MAX_DIR_DEPTH 32                // scratch directories nested deeper are left behind
+
+#if defined(__x86_64__)
+#define PROFILE_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+#define PROFILE_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#endif
+
+static struct {
+    bool enabled;
+    char cc[1024];                          // resolved path of the compiler, then its arguments
+    char *argv[PROFILE_MAX_CC_ARGS + 1];
+    int  argc;
+    char path_env[1024];                    // the compiler's environment is PATH, TMPDIR and LC_ALL only
+    int  budget_ms;
+    int  max_running;
+    uid_t uid;                              // the profile user children switch to
+    gid_t gid;
+    struct sock_filter filter[PROFILE_MAX_FILTER];
+    struct sock_fprog fprog;
+    atomic_int running;
+} PR;
+
+/* --------------------------- configuration --------------------------- */
+
+// the compiler's path from $PATH when it is given as a bare name, done once rather than in each child
+static bool resolve_program(const char *name, char *out, size_t out_size) {
+    if (strchr(name, '/')) return snprintf(out, out_size, "%s", name) < (int)out_size && access(out, X_OK) == 0;
+    const char *path = getenv("PATH");
+    if (!path || !*path) path = "/usr/local/bin:/usr/bin:/bin";
+    for (const char *p = path; *p; ) {
+        size_t n = strcspn(p, ":");
+        if (n && snprintf(out, out_size, "%.*s/%s", (int)n, p, name) < (int)out_size && access(out, X_OK) == 0)
+            return true;
+        p += n;
+        if (*p == ':') p++;
+    }
+    return false;
+}
+
+/* The submitted program may not start processes, open sockets, signal
+   or trace other processes, change any path (create, link, rename,
+   remove, chmod, chown, truncate), open a file for writing, or reach for
+   namespaces and kernel interfaces it has no use for; those calls fail
+   with EPERM. Anything built for another ABI (x32, a 32-bit compat call)
+   is killed. execve stays allowed, since the filter is installed before
+   ./prog is run, but whatever it execs inherits the filter, the uid, the
+   chroot and the limits. */
+static bool filter_build(void) {
+#ifdef PROFILE_AUDIT_ARCH
+    static const int DENIED[] = {
+#ifdef __NR_fork
+        __NR_fork, __NR_vfork,
+#endif
+#ifdef __NR_clone3
+        __NR_clone3,
+#endif
+        __NR_clone, __NR_execveat, __NR_kill, __NR_tkill, __NR_tgkill, __NR_ptrace,
+        __NR_process_vm_readv, __NR_process_vm_writev, __NR_socket, __NR_socketpair,
+        __NR_unshare, __NR_setns, __NR_mount, __NR_umount2, __NR_pivot_root, __NR_chroot,
+        __NR_bpf, __NR_perf_event_open, __NR_keyctl, __NR_add_key, __NR_request_key,
+        __NR_userfaultfd, __NR_personality,
+        __NR_mknodat, __NR_mkdirat, __NR_unlinkat, __NR_symlinkat, __NR_linkat, __NR_renameat2,
+        __NR_fchmod, __NR_fchmodat, __NR_fchown, __NR_fchownat, __NR_truncate, __NR_ftruncate,
+        __NR_fallocate,
+#ifdef __NR_renameat
+        __NR_renameat,
+#endif
+#ifdef __NR_open
+        __NR_creat, __NR_mknod, __NR_mkdir, __NR_rmdir, __NR_unlink, __NR_symlink, __NR_link,
+        __NR_rename, __NR_chmod, __NR_chown, __NR_lchown,
+#endif
+#ifdef __NR_openat2
+        __NR_openat2,  // its flags sit behind a pointer, out of the filter's reach
+#endif
+#ifdef __NR_io_uring_setup
+        __NR_io_uring_setup,
+#endif
+#ifdef __NR_pidfd_open
+        __NR_pidfd_open, __NR_pidfd_send_signal,
+#endif
+    };
+    // reading stays allowed (the chroot leaves nothing but the program to read); writing does not
+    static const struct { int nr, flags_arg; } OPENS[] = {
+        { __NR_openat, 2 },
+#ifdef __NR_open
+        { __NR_open, 1 },
+#endif
+    };
+    size_t k = sizeof(DENIED) / sizeof(DENIED[0]), nopens = sizeof(OPENS) / sizeof(OPENS[0]), n = 0;
+    if (4 + 2 + 5 * nopens + k + 2 > PROFILE_MAX_FILTER) return false;
+    struct sock_filter *f = PR.filter;
+    f[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+    f[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PROFILE_AUDIT_ARCH, 1, 0);
+    f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS);
+    f[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+#ifdef __x86_64__
+    f[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 0x40000000u, 0, 1);  // __X32_SYSCALL_BIT
+    f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS);
+#endif
+    // an open answers on the spot; any other call skips the block with the number still loaded
+    for (size_t i = 0; i < nopens; i++) {
+        f[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned)OPENS[i].nr, 0, 4);
+        f[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                              offsetof(struct seccomp_data, args) + 8 * OPENS[i].flags_arg +
+                                              (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ ? 4 : 0));  // the low half
+        f[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, O_WRONLY | O_RDWR | O_CREAT | O_TRUNC, 0, 1);
+        f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM);
+        f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    }
+    // each match jumps over the rest of the list and the ALLOW to the ERRNO at the end
+    for (size_t i = 0; i < k; i++)
+        f[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned)DENIED[i], (unsigned char)(k - i), 0);
+    f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM);
+    PR.fprog = (struct sock_fprog){ .len = (unsigned short)n, .filter = PR.filter };
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* The children switch to `user`, who must not be root, and the program
+   is chrooted into its scratch directory. Both take root, so without it
+   profiling is refused rather than run with the parser's own uid. */
+static const char *choose_user(const char *user) {
+    if (geteuid() != 0) return "needs the parser to start as root, to run submissions as --profile-user";
+    if (!user || !*user) user = getenv("BIGO_PROFILE_USER");
+    if (!user || !*user) user = PROFILE_DEFAULT_USER;
+    struct passwd *pw = getpwnam(user);
+    if (!pw) return "no such --profile-user ($BIGO_PROFILE_USER, default nobody)";
+    if (pw->pw_uid == 0 || pw->pw_gid == 0) return "--profile-user must not be root";
+    PR.uid = pw->pw_uid;
+    PR.gid = pw->pw_gid;
+    return NULL;
+}
+
+int profile_init(const char *cc, const char *user, int budget_ms, int workers, const char **error) {
+    PR.enabled = false;
+    // a profile holds its HTTP worker for the whole budget; one worker always stays for everything else
+    PR.max_running = workers - 1 < PROFILE_MAX_RUNNING ? workers - 1 : PROFILE_MAX_RUNNING;
+    if (PR.max_running < 1) { *error = "needs at least 2 worker threads (--threads)"; return -1; }
+    *error = "no usable compiler (--profile-cc, $BIGO_CC or cc)";
+    if (!cc || !*cc) cc = getenv("BIGO_CC");
+    if (!cc || !*cc) cc = "cc";
+
+    // split into words in a scratch copy; the first is resolved into PR.cc, the rest follow it
+    char words[sizeof(PR.cc)];
+    if (snprintf(words, sizeof(words), "%s", cc) >= (int)sizeof(words)) return -1;
+    char *save = NULL;
+    char *first = strtok_r(words, " ", &save);
+    if (!first || !resolve_program(first, PR.cc, sizeof(PR.cc))) return -1;
+    size_t used = strlen(PR.cc) + 1;
+    PR.argv[0] = PR.cc;
+    PR.argc = 1;
+    for (char *w = strtok_r(NULL, " ", &save); w; w = strtok_r(NULL, " ", &save)) {
+        size_t n = strlen(w) + 1;
+        if (PR.argc == PROFILE_MAX_CC_ARGS || used + n > sizeof(PR.cc)) return -1;
+        memcpy(PR.cc + used, w, n);
+        PR.argv[PR.argc++] = PR.cc + used;
+        used += n;
+    }
+    PR.argv[PR.argc] = NULL;
+    const char *path = getenv("PATH");
+    if (snprintf(PR.path_env, sizeof(PR.path_env), "PATH=%s", path && *path ? path : "/usr/local/bin:/usr/bin:/bin") >=
+        (int)sizeof(PR.path_env)) snprintf(PR.path_env, sizeof(PR.path_env), "PATH=/usr/local/bin:/usr/bin:/bin");
+    if (!filter_build()) { *error = "no syscall filter for this architecture"; return -1; }
+    if ((*error = choose_user(user)) != NULL) return -1;
+    PR.budget_ms = budget_ms > 0 ? budget_ms : PROFILE_DEFAULT_BUDGET_MS;
+    PR.enabled = true;
+    return 0;
+}
+
+bool profile_enabled(void) { return PR.enabled; }
+
+/* --------------------------- child processes ---------------------------
+   Everything a child needs is prepared before fork(): the server is
+   multi-threaded, so between fork and exec the child only makes
+   async-signal-safe calls. Each child leads its own process group, so a
+   compiler and the tools it starts are killed together. Children drop to
+   the profile user (see choose_user) and take on their limits before
+   they exec; the submitted program is also confined: chrooted into the
+   scratch directory (it is linked statically, so it needs nothing else),
+   no processes, few files and the syscall filter.
+*/
+
+typedef struct {
+    const char *dir;     // working directory
+    int out_fd;          // becomes stdout and stderr
+    int count_fd;        // becomes fd 3, -1 for none
+    rlim_t cpu_s;        // CPU seconds
+    rlim_t mem_bytes;    // address space
+    rlim_t file_bytes;   // largest file it may write
+    bool confined;       // the submitted program
+} spawn_opts;
+
+// a pipe whose ends stay out of every other exec (children close what they do not keep anyway)
+static int pipe_cloexec(int fds[2]) {
+    if (pipe(fds) != 0) return -1;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+static pid_t spawn(char *const argv[], char *const envp[], const spawn_opts *o) {
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd < 0) return -1;
+    struct rlimit nofile;
+    int max_fd = getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur != RLIM_INFINITY &&
+                 nofile.rlim_cur < 65536 ? (int)nofile.rlim_cur : 65536;
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid > 0) setpgid(pid, pid);  // whichever of the two runs first
+        close(null_fd);
+        return pid;
+    }
+
+    setpgid(0, 0);
+    if (chdir(o->dir) != 0) _exit(126);
+    dup2(null_fd, 0);
+    dup2(o->out_fd >= 0 ? o->out_fd : null_fd, 1);
+    dup2(o->out_fd >= 0 ? o->out_fd : null_fd, 2);
+    if (o->count_fd == 3) fcntl(3, F_SETFD, 0);  // dup2 onto itself would keep FD_CLOEXEC
+    else if (o->count_fd >= 0) dup2(o->count_fd, 3);
+    // listening socket, client connections, epoll: none of them are the child's business
+    for (int fd = o->count_fd >= 0 ? 4 : 3; fd < max_fd; fd++) close(fd);
+    struct rlimit cpu = { o->cpu_s, o->cpu_s + 1 };
+    struct rlimit mem = { o->mem_bytes, o->mem_bytes };
+    struct rlimit fsize = { o->file_bytes, o->file_bytes };
+    struct rlimit none = { 0, 0 };
+    if (setrlimit(RLIMIT_CPU, &cpu) != 0 || setrlimit(RLIMIT_AS, &mem) != 0 ||
+        setrlimit(RLIMIT_FSIZE, &fsize) != 0 || setrlimit(RLIMIT_CORE, &none) != 0) _exit(126);
+    if (o->confined) {
+        struct rlimit files = { 16, 16 };
+        setrlimit(RLIMIT_NOFILE, &files);
+        if (chroot(".") != 0 || chdir("/") != 0) _exit(126);  // while still root
+    }
+    if (setgroups(0, NULL) != 0 || setgid(PR.gid) != 0 || setuid(PR.uid) != 0) _exit(126);
+    if (o->confined) {
+        /* only now: lowered before setuid, the limit would fail the execve
+           below (PF_NPROC_EXCEEDED), and root would not be held to it */
+        if (setrlimit(RLIMIT_NPROC, &none) != 0) _exit(126);
+        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+            prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &PR.fprog) != 0) _exit(126);
+    }
+    execve(argv[0], argv, envp);
+    _exit(127);
+}
+
+/* Read fd until EOF into buf (truncated at cap - 1, NUL-terminated) and
+   reap pid; at the deadline the process group is killed. Returns the
+   wait status, with *timed_out set when it had to be killed. */
+static int collect(pid_t pid, int fd, char *buf, size_t cap, uint64_t deadline_ns, bool *timed_out) {
+    size_t len = 0;
+    *timed_out = false;
+    for (bool open = true; open; ) {
+        uint64_t now = metrics_now_ns();
+        if (now >= deadline_ns) { *timed_out = true; break; }
+        struct pollfd p = { fd, POLLIN, 0 };
+        int wait_ms = (int)((deadline_ns - now) / 1000000u) + 1;
+        int r = poll(&p, 1, wait_ms);
+        if (r < 0 && errno != EINTR) break;
+        if (r <= 0) continue;
+        char chunk[512];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { open = false; continue; }
+        size_t keep = (size_t)n < cap - 1 - len ? (size_t)n : cap - 1 - len;
+        memcpy(buf + len, chunk, keep);
+        len += keep;
+    }
+    buf[len] = '\0';
+
+    // the output is closed; the process may still be on its way out
+    int status = 0;
+    for (;;) {
+        if (*timed_out) {
+            kill(-pid, SIGKILL);
+            kill(pid, SIGKILL);
+        }
+        pid_t r = waitpid(pid, &status, *timed_out ? 0 : WNOHANG);
+        if (r == pid || (r < 0 && errno != EINTR)) break;
+        if (r == 0 && metrics_now_ns() < deadline_ns) usleep(1000);
+        else if (r == 0) *timed_out = true;
+    }
+    if (*timed_out) kill(-pid, SIGKILL);  // anything its children left behind
+    return status;
+}
+
+/* --------------------------- fitting ---------------------------
+   In log space every model is ln(ops) = ln g(n) + c, so the constant
+   drops out as the mean residual and what is left measures the fit. The
+   power and exponential models take their exponent and base from a
+   least-squares line; the others have no free parameter.
+*/
+
+typedef struct {
+    long n;
+    unsigned long long ops;
+} sample;
+
+// y = a + b x by least squares; b is 0 when x does not vary
+static double slope_of(const double *x, const double *y, int m) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < m; i++) { sx += x[i]; sy += y[i]; sxx += x[i] * x[i]; sxy += x[i] * y[i]; }
+    double d = m * sxx - sx * sx;
+    return d > 0 ? (m * sxy - sx * sy) / d : 0;
+}
+
+// root mean square of y - g about its mean
+static double spread(const double *y, const double *g, int m) {
+    double mean = 0, ss = 0;
+    for (int i = 0; i < m; i++) mean += y[i] - g[i];
+    mean /= m;
+    for (int i = 0; i < m; i++) { double r = y[i] - g[i] - mean; ss += r * r; }
+    return sqrt(ss / m);
+}
+
+// v rounded to `digits` decimals, as the nearest double (dividing, not multiplying back)
+static double round_to(double v, int digits) { double s = pow(10, digits); return round(v * s) / s; }
+
+/* The simplest model whose fit is within 10% (plus a little noise) of the
+   best one, so a clean O(n) is not reported as O(n^1) dressed up. */
+static json_t *fit(const sample *S, int ns) {
+    // the smallest sizes are mostly call overhead; drop them when there are points enough
+    int first = 0;
+    while (first < ns && S[first].n < 16) first++;
+    if (ns - first < 4) first = 0;
+    int m = ns - first;
+
+    double x[PROFILE_MAX_SAMPLES], ln_n[PROFILE_MAX_SAMPLES], y[PROFILE_MAX_SAMPLES];
+    for (int i = 0; i < m; i++) {
+        x[i] = (double)S[first + i].n;
+        ln_n[i] = log(x[i]);
+        y[i] = log((double)S[first + i].ops + 1);
+    }
+    double exponent = slope_of(ln_n, y, m);
+    int k = (int)lround(exponent) < 2 ? 2 : (int)lround(exponent);
+    double base = exp(slope_of(x, y, m));
+
+    enum { M_CONST, M_LOG, M_N, M_NLOGN, M_POW, M_EXP, NMODELS };
+    double g[NMODELS][PROFILE_MAX_SAMPLES];
+    for (int i = 0; i < m; i++) {
+        g[M_CONST][i] = 0;
+        g[M_LOG][i] = log(ln_n[i]);
+        g[M_N][i] = ln_n[i];
+        g[M_NLOGN][i] = ln_n[i] + log(ln_n[i]);
+        g[M_POW][i] = k * ln_n[i];
+        g[M_EXP][i] = x[i] * log(base);
+    }
+    double err[NMODELS], best = INFINITY;
+    for (int j = 0; j < NMODELS; j++) {
+        err[j] = j == M_EXP && base < 1.05 ? INFINITY : spread(y, g[j], m);
+        if (err[j] < best) best = err[j];
+    }
+    int pick = 0;
+    while (err[pick] > best * 1.1 + 0.05) pick++;
+
+    char model[32];
+    switch (pick) {
+    case M_CONST: snprintf(model, sizeof(model), "1"); break;
+    case M_LOG:   snprintf(model, sizeof(model), "log n"); break;
+    case M_N:     snprintf(model, sizeof(model), "n"); break;
+    case M_NLOGN: snprintf(model, sizeof(model), "n log n"); break;
+    case M_POW:   snprintf(model, sizeof(model), "n^%d", k); break;
+    default:
+        if (fabs(base - 2) < 0.1) snprintf(model, sizeof(model), "2^n");
+        else snprintf(model, sizeof(model), "%.2g^n", base);
+        break;
+    }
+    char complexity[40];
+    snprintf(complexity, sizeof(complexity), "O(%s)", model);
+
+    json_t *out = json_object();
+    json_object_set_new(out, "complexity", json_string(complexity));
+    json_object_set_new(out, "model", json_string(model));
+    json_object_set_new(out, "exponent", json_real(round_to(exponent, 2)));
+    json_object_set_new(out, "fitError", json_real(round_to(err[pick], 3)));
+    return out;
+}
+
+/* --------------------------- profile --------------------------- */
+
+static json_t *profile_error(const char *msg, const char *entry) {
+    json_t *o = json_object();
+    json_object_set_new(o, "error", json_string(msg));
+    if (entry && *entry) json_object_set_new(o, "entry", json_string(entry));
+    return o;
+}
+
+static bool write_file(const char *path, const char *data, size_t len) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    bool ok = true;
+    for (size_t off = 0; ok && off < len; ) {
+        ssize_t n = write(fd, data + off, len - off);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) off += (size_t)n;
+    }
+    return close(fd) == 0 && ok;
+}
+
+/* name under parent_fd and everything below it, whatever the compiler
+   or the program left there; symlinks are removed, never followed */
+static void remove_tree(int parent_fd, const char *name, int depth) {
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (d) {
+        for (struct dirent *e; (e = readdir(d)) != NULL; ) {
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+            if (unlinkat(fd, e->d_name, 0) != 0 && errno == EISDIR && depth < PROFILE_MAX_DIR_DEPTH)
+                remove_tree(fd, e->d_name, depth + 1);
+        }
+        closedir(d);  // and fd
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    unlinkat(parent_fd, name, AT_REMOVEDIR);
+}
+
+/* compile prog.c in dir; NULL on success, else a static reason with the
+   compiler's output in log, which is for the server's log only: it quotes
+   whatever the compiler read */
+static const char *compile(const char *dir, uint64_t deadline_ns, char *log, size_t log_size) {
+    char *argv[PROFILE_MAX_CC_ARGS + 8];
+    int argc = 0;
+    for (int i = 0; i < PR.argc; i++) argv[argc++] = PR.argv[i];
+    char *const flags[] = { "-std=gnu11", "-O1", "-w", "-static", "-o", "prog", "prog.c", "-lm" };
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) argv[argc++] = flags[i];
+    argv[argc] = NULL;
+
+    char tmpdir[96];
+    snprintf(tmpdir, sizeof(tmpdir), "TMPDIR=%s", dir);
+    char *envp[] = { PR.path_env, tmpdir, "LC_ALL=C", NULL };
+
+    int pipe_fd[2];
+    if (pipe_cloexec(pipe_fd) != 0) return "cannot start the compiler";
+    uint64_t now = metrics_now_ns();
+    uint64_t left_ms = now < deadline_ns ? (deadline_ns - now) / 1000000u : 0;
+    spawn_opts o = { .dir = dir, .out_fd = pipe_fd[1], .count_fd = -1, .cpu_s = (rlim_t)(left_ms / 1000 + 1),
+                     .mem_bytes = PROFILE_CC_MEM_BYTES, .file_bytes = PROFILE_CC_FILE_BYTES };
+    pid_t pid = spawn(argv, envp, &o);
+    close(pipe_fd[1]);
+    if (pid < 0) { close(pipe_fd[0]); return "cannot start the compiler"; }
+    bool timed_out;
+    int status = collect(pid, pipe_fd[0], log, log_size, deadline_ns, &timed_out);
+    close(pipe_fd[0]);
+    if (timed_out) return "compiling ran out of time";
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return "the instrumented source does not compile";
+    return NULL;
+}
+
+typedef enum { RUN_OK, RUN_OVER, RUN_TIMEOUT, RUN_CRASH } run_result;
+
+// one run of the program at size n; *ops is what it counted
+static run_result run_once(const char *dir, long n, uint64_t deadline_ns, unsigned long long *ops) {
+    char n_arg[24], cap_arg[24];
+    snprintf(n_arg, sizeof(n_arg), "%ld", n);
+    snprintf(cap_arg, sizeof(cap_arg), "%llu", PROFILE_MAX_OPS);
+    char *argv[] = { "./prog", n_arg, cap_arg, NULL };
+    char *envp[] = { NULL };
+
+    int pipe_fd[2];
+    if (pipe_cloexec(pipe_fd) != 0) return RUN_CRASH;
+    uint64_t now = metrics_now_ns();
+    uint64_t left_ms = now < deadline_ns ? (deadline_ns - now) / 1000000u : 0;
+    spawn_opts o = { .dir = dir, .out_fd = -1, .count_fd = pipe_fd[1], .cpu_s = (rlim_t)(left_ms / 1000 + 1),
+                     .mem_bytes = PROFILE_MEM_BYTES, .file_bytes = 0, .confined = true };
+    pid_t pid = spawn(argv, envp, &o);
+    close(pipe_fd[1]);
+    if (pid < 0) { close(pipe_fd[0]); return RUN_CRASH; }
+    char line[64];
+    bool timed_out;
+    collect(pid, pipe_fd[0], line, sizeof(line), deadline_ns, &timed_out);
+    close(pipe_fd[0]);
+    if (timed_out) return RUN_TIMEOUT;
+    if (sscanf(line, "ops %llu", ops) == 1) return RUN_OK;
+    if (sscanf(line, "over %llu", ops) == 1) return RUN_OVER;
+    return RUN_CRASH;
+}
+
+/* Runs at n = 4, 6, 8, 11, 16, 23, ... (a factor of sqrt 2 apart) until
+   one passes the operation limit, the budget runs out, n reaches
+   PROFILE_MAX_N or the program crashes; the last run does not count. */
+static json_t *measure(const char *dir, const char *entry, uint64_t deadline_ns) {
+    sample S[PROFILE_MAX_SAMPLES];
+    int ns = 0;
+    const char *stopped = "largest size";
+    char crash[48];
+    for (int k = 0; ns < PROFILE_MAX_SAMPLES; k++) {
+        long n = lround(4 * pow(2, k / 2.0));
+        if (n > PROFILE_MAX_N) break;
+        if (metrics_now_ns() >= deadline_ns) { stopped = "time budget"; break; }
+        unsigned long long ops = 0;
+        run_result r = run_once(dir, n, deadline_ns, &ops);
+        if (r == RUN_OVER) { stopped = "operation limit"; break; }
+        if (r == RUN_TIMEOUT) { stopped = "time budget"; break; }
+        if (r == RUN_CRASH) {
+            snprintf(crash, sizeof(crash), "crashed at n=%ld", n);
+            stopped = crash;
+            break;
+        }
+        S[ns++] = (sample){ n, ops };
+    }
+    if (ns < 3) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "too few sizes measured (%d): %s", ns, stopped);
+        return profile_error(msg, entry);
+    }
+
+    json_t *out = fit(S, ns);
+    json_object_set_new(out, "entry", json_string(entry));
+    json_t *samples = json_array();
+    for (int i = 0; i < ns; i++) {
+        json_t *s = json_object();
+        json_object_set_new(s, "n", json_integer(S[i].n));
+        json_object_set_new(s, "ops", json_integer((json_int_t)S[i].ops));
+        json_array_append_new(samples, s);
+    }
+    json_object_set_new(out, "samples", samples);
+    json_object_set_new(out, "stoppedBy", json_string(stopped));
+    return out;
+}
+
+json_t *profile_run(const char *code, size_t len, const char *entry, uint64_t deadline_ns) {
+    if (!PR.enabled) return profile_error("profiling is disabled", NULL);
+    uint64_t t0 = metrics_now_ns();
+    uint64_t budget_end = t0 + (uint64_t)PR.budget_ms * 1000000u;
+    if (deadline_ns && deadline_ns < budget_end) budget_end = deadline_ns;
+
+    parse_options opts = { .deadline_ns = budget_end };
+    char chosen[128];
+    size_t src_len = 0;
+    const char *error = NULL;
+    char *src = parse_instrument(code, len, entry, &opts, chosen, sizeof(chosen), &src_len, &error);
+    if (!src) return profile_error(error, chosen);
+
+    if (atomic_fetch_add(&PR.running, 1) >= PR.max_running) {
+        atomic_fetch_sub(&PR.running, 1);
+        free(src);
+        return profile_error("profiler busy", chosen);
+    }
+    json_t *out = NULL;
+    char dir[] = "/tmp/bigo-profile-XXXXXX";
+    if (!mkdtemp(dir)) {
+        out = profile_error("cannot create a scratch directory", chosen);
+    } else {
+        char path[64], log[PROFILE_LOG_BYTES] = "";
+        snprintf(path, sizeof(path), "%s/prog.c", dir);
+        const char *failed = NULL;
+        if (!write_file(path, src, src_len)) failed = "cannot write the source";
+        else if (chown(dir, PR.uid, PR.gid) != 0 || chown(path, PR.uid, PR.gid) != 0)
+            failed = "cannot hand the scratch directory to the profile user";
+        else failed = compile(dir, budget_end, log, sizeof(log));
+        if (failed && *log) fprintf(stderr, "[profile] %s (entry %s):\n%s%s", failed, chosen, log,
+                                    log[strlen(log) - 1] == '\n' ? "" : "\n");
+        out = failed ? profile_error(failed, chosen) : measure(dir, chosen, budget_end);
+        remove_tree(AT_FDCWD, dir, 0);
+    }
+    atomic_fetch_sub(&PR.running, 1);
+    free(src);
+    metrics_observe(METRIC_PROFILE, t0);
+    return out;
+}
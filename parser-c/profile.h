@@ -0,0 +1,37 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <jansson.h>
+
+/* Empirical complexity: the submission is instrumented (parse_instrument
+   in parse.h), compiled, and run in a resource-limited child process over
+   a geometric range of input sizes; the operation counts are fitted
+   against O(1), O(log n), O(n), O(n log n), O(n^k) and O(c^n). This
+   compiles and runs whatever clients send, so it stays off unless
+   profile_init() was called. The parser must start as root: it runs the
+   compiler and the program as an unprivileged user, and the program,
+   linked statically, chrooted into its own scratch directory under a
+   syscall filter (no processes, sockets, signals to others, path changes
+   or opening files for writing). It still belongs in a sandboxed
+   deployment. */
+
+/* cc: compiler command, words split on spaces (NULL: $BIGO_CC, else "cc");
+   it must be able to link statically. user: who the children run as
+   (NULL: $BIGO_PROFILE_USER, else "nobody"). workers: the HTTP worker
+   threads; profiles at once stay below it, so at least 2 are needed.
+   -1 with *error set when profiling cannot be enabled. */
+int  profile_init(const char *cc, const char *user, int budget_ms, int workers, const char **error);
+bool profile_enabled(void);
+
+/* {"complexity":"O(n log n)","model":"n log n","exponent":1.08,"fitError":0.03,"entry":"msort",
+     "samples":[{"n":4,"ops":21},...],"stoppedBy":"operation limit"}
+   or {"error":"...", plus "entry" when one was chosen}; the compiler's
+   output goes to the server's stderr, never to the client.
+   entry names the function to run (NULL: parse_instrument picks one);
+   deadline_ns (metrics_now_ns() time, 0 = none) cuts the budget short. */
+json_t *profile_run(const char *code, size_t len, const char *entry, uint64_t deadline_ns);
+
+#endif
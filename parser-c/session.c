@@ -0,0 +1,144 @@
+#include "session.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef struct {
+    char id[SESSION_ID_MAX + 1];
+    parse_doc *doc;
+    bool busy;
+    time_t last_used;
+} session_entry;
+
+// a few hundred sessions at most, so a flat table scanned linearly is enough
+static struct {
+    pthread_mutex_t mu;
+    session_entry *items;
+    size_t len, cap;
+    int ttl;
+    uint64_t counter;
+} T = { .mu = PTHREAD_MUTEX_INITIALIZER };
+
+void session_init(size_t max_sessions, int ttl_seconds) {
+    pthread_mutex_lock(&T.mu);
+    T.cap = max_sessions;
+    T.ttl = ttl_seconds;
+    T.items = (session_entry*)calloc(max_sessions ? max_sessions : 1, sizeof(session_entry));
+    if (!T.items) T.cap = 0;
+    pthread_mutex_unlock(&T.mu);
+}
+
+bool session_id_valid(const char *id) {
+    if (!id) return false;
+    size_t n = 0;
+    for (const char *c = id; *c; c++, n++) {
+        bool ok = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') ||
+                  *c == '_' || *c == '-';
+        if (!ok || n >= SESSION_ID_MAX) return false;
+    }
+    return n > 0;
+}
+
+void session_new_id(char out[SESSION_ID_MAX + 1]) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    pthread_mutex_lock(&T.mu);
+    uint64_t x = ++T.counter;
+    pthread_mutex_unlock(&T.mu);
+    // splitmix64 of time and a counter: unique per process, hard to guess in passing
+    x += (uint64_t)ts.tv_sec * 1000000007ULL + (uint64_t)ts.tv_nsec;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    snprintf(out, SESSION_ID_MAX + 1, "s%016llx", (unsigned long long)x);
+}
+
+static session_entry *find(const char *id) {
+    for (size_t i = 0; i < T.len; i++) {
+        if (strcmp(T.items[i].id, id) == 0) return &T.items[i];
+    }
+    return NULL;
+}
+
+static void remove_at(size_t i) {
+    parse_doc_free(T.items[i].doc);
+    T.items[i] = T.items[--T.len];
+}
+
+// drop expired idle sessions; if still full, the least recently used idle one
+static bool make_room(time_t now) {
+    for (size_t i = 0; i < T.len; ) {
+        if (!T.items[i].busy && now - T.items[i].last_used > T.ttl) remove_at(i);
+        else i++;
+    }
+    if (T.len < T.cap) return true;
+    size_t victim = T.len;
+    for (size_t i = 0; i < T.len; i++) {
+        if (T.items[i].busy) continue;
+        if (victim == T.len || T.items[i].last_used < T.items[victim].last_used) victim = i;
+    }
+    if (victim == T.len) return false;
+    remove_at(victim);
+    return true;
+}
+
+session_status session_put(const char *id, parse_doc *doc) {
+    time_t now = time(NULL);
+    pthread_mutex_lock(&T.mu);
+    session_entry *e = find(id);
+    if (e && e->busy) { pthread_mutex_unlock(&T.mu); return SESSION_BUSY; }
+    if (e) {
+        parse_doc_free(e->doc);
+    } else {
+        if (!make_room(now)) { pthread_mutex_unlock(&T.mu); return SESSION_BUSY; }
+        e = &T.items[T.len++];
+        snprintf(e->id, sizeof(e->id), "%s", id);
+    }
+    e->doc = doc;
+    e->busy = false;
+    e->last_used = now;
+    pthread_mutex_unlock(&T.mu);
+    return SESSION_OK;
+}
+
+session_status session_checkout(const char *id, parse_doc **doc) {
+    session_status st = SESSION_UNKNOWN;
+    *doc = NULL;
+    pthread_mutex_lock(&T.mu);
+    session_entry *e = find(id);
+    if (e && time(NULL) - e->last_used > T.ttl && !e->busy) {
+        remove_at((size_t)(e - T.items));
+        e = NULL;
+    }
+    if (e) {
+        if (e->busy) {
+            st = SESSION_BUSY;
+        } else {
+            e->busy = true;
+            *doc = e->doc;
+            st = SESSION_OK;
+        }
+    }
+    pthread_mutex_unlock(&T.mu);
+    return st;
+}
+
+void session_release(const char *id) {
+    pthread_mutex_lock(&T.mu);
+    session_entry *e = find(id);
+    if (e) {
+        e->busy = false;
+        e->last_used = time(NULL);
+    }
+    pthread_mutex_unlock(&T.mu);
+}
+
+void session_drop(const char *id) {
+    pthread_mutex_lock(&T.mu);
+    session_entry *e = find(id);
+    if (e) remove_at((size_t)(e - T.items));
+    pthread_mutex_unlock(&T.mu);
+}
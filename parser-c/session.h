@@ -0,0 +1,29 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "parse.h"
+
+/* Edit sessions for POST /parse/edit: session id -> parse_doc.
+   A document is checked out by one request at a time; the table is
+   bounded by count and idle sessions expire after a TTL. */
+
+#define SESSION_ID_MAX 64
+
+typedef enum { SESSION_OK = 0, SESSION_UNKNOWN, SESSION_BUSY } session_status;
+
+void session_init(size_t max_sessions, int ttl_seconds);
+
+// true if id is 1..SESSION_ID_MAX chars of [A-Za-z0-9_-]
+bool session_id_valid(const char *id);
+void session_new_id(char out[SESSION_ID_MAX + 1]);
+
+// install doc under id, replacing (and freeing) an idle previous one
+session_status session_put(const char *id, parse_doc *doc);
+// take exclusive use of the document; pair with session_release or session_drop
+session_status session_checkout(const char *id, parse_doc **doc);
+void session_release(const char *id);
+void session_drop(const char *id);
+
+#endif
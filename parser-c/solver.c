@@ -0,0 +1,1107 @@
+#include "solver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <math.h>
+#include <pthread.h>
+
+/* Every helper below mirrors the Python function of the same name in
+   analyzer/app.py, including its formatting, so both produce the same
+   answer for the same summary. */
+
+/* --------------------------- python-like values --------------------------- */
+
+// Python truthiness of a JSON value
+static bool truthy(const json_t *v) {
+    if (!v || json_is_null(v) || json_is_false(v)) return false;
+    if (json_is_integer(v)) return json_integer_value(v) != 0;
+    if (json_is_real(v)) return json_real_value(v) != 0.0;
+    if (json_is_string(v)) return json_string_length(v) > 0;
+    if (json_is_array(v)) return json_array_size(v) > 0;
+    if (json_is_object(v)) return json_object_size(v) > 0;
+    return true;
+}
+
+// isinstance(v, (int, float)); bools count, as they do in Python
+static bool is_number(const json_t *v, double *out) {
+    if (json_is_integer(v)) { *out = (double)json_integer_value(v); return true; }
+    if (json_is_real(v)) { *out = json_real_value(v); return true; }
+    if (json_is_boolean(v)) { *out = json_is_true(v) ? 1.0 : 0.0; return true; }
+    return false;
+}
+
+// x or 0, as a number
+static double num_or_zero(const json_t *v) {
+    double d;
+    return truthy(v) && is_number(v, &d) ? d : 0.0;
+}
+
+// repr() of a float: shortest round-trip digits, exponent outside [1e-4, 1e16)
+static void py_float_repr(double x, char *out, size_t n) {
+    if (isnan(x)) { snprintf(out, n, "nan"); return; }
+    if (isinf(x)) { snprintf(out, n, x < 0 ? "-inf" : "inf"); return; }
+    char e[40];
+    int p = 0;
+    for (; p < 17; p++) {
+        snprintf(e, sizeof(e), "%.*e", p, x);
+        if (strtod(e, NULL) == x) break;
+    }
+    int exp10 = atoi(strchr(e, 'e') + 1);
+    if (exp10 < -4 || exp10 >= 16) { snprintf(out, n, "%s", e); return; }
+    int decimals = p - exp10 > 0 ? p - exp10 : 0;
+    snprintf(out, n, "%.*f%s", decimals, x, decimals ? "" : ".0");
+}
+
+// str(v) for the values that end up in messages (numbers, strings, bools)
+static void py_str(const json_t *v, char *out, size_t n) {
+    if (json_is_integer(v)) snprintf(out, n, "%lld", (long long)json_integer_value(v));
+    else if (json_is_real(v)) py_float_repr(json_real_value(v), out, n);
+    else if (json_is_boolean(v)) snprintf(out, n, json_is_true(v) ? "True" : "False");
+    else if (json_is_string(v)) snprintf(out, n, "%s", json_string_value(v));
+    else if (!v || json_is_null(v)) snprintf(out, n, "None");
+    else snprintf(out, n, "?");
+}
+
+// dict.get(key, {}) / .get(key, []) for the shapes the analyzer walks
+static json_t *get(const json_t *obj, const char *key) {
+    return json_is_object(obj) ? json_object_get(obj, key) : NULL;
+}
+
+static bool has_keys(const json_t *r, const char *const *keys) {
+    for (; *keys; keys++) if (!json_object_get(r, *keys)) return false;
+    return true;
+}
+
+static void append(json_t *list, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void append(json_t *list, const char *fmt, ...) {
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    json_array_append_new(list, json_string(buf));
+}
+
+/* --------------------------- f(n) --------------------------- */
+
+typedef enum { F_CONST, F_LOG, F_N, F_NK, F_NLOGN, F_UNSUPPORTED } f_kind;
+
+// 1.00 -> 1, else two decimals
+static void fmt_exp(double x, char *out, size_t n) {
+    double r = nearbyint(x);  // round half to even, like round()
+    if (fabs(x - r) < 1e-9) snprintf(out, n, "%lld", (long long)r);
+    else snprintf(out, n, "%.2f", x);
+}
+
+// float(s) for an already stripped string
+static bool py_float(const char *s, double *out) {
+    if (!*s || strchr(s, 'x') || strchr(s, 'X')) return false;
+    char *end = NULL;
+    *out = strtod(s, &end);
+    while (end && isspace((unsigned char)*end)) end++;
+    return end && *end == '\0' && end != s;
+}
+
+static f_kind classify_f(const char *expr, double *k) {
+    char f[128];
+    const char *s = expr ? expr : "";
+    while (isspace((unsigned char)*s)) s++;
+    size_t n = strlen(s);
+    while (n > 0 && isspace((unsigned char)s[n - 1])) n--;
+    if (n >= sizeof(f)) return F_UNSUPPORTED;
+    for (size_t i = 0; i < n; i++) f[i] = (char)tolower((unsigned char)s[i]);
+    f[n] = '\0';
+    *k = 0.0;
+
+    if (strcmp(f, "1") == 0 || strcmp(f, "constant") == 0) return F_CONST;
+    if (strcmp(f, "log n") == 0) return F_LOG;
+    if (strcmp(f, "n") == 0) return F_N;
+    if (strncmp(f, "n^", 2) == 0) return py_float(f + 2, k) ? F_NK : F_UNSUPPORTED;
+    if (strcmp(f, "n log n") == 0) return F_NLOGN;
+    return F_UNSUPPORTED;
+}
+
+// is inferred f(n) asymptotically stronger than current f(n)?
+static bool compare_growth(f_kind current, double current_k, f_kind inferred, double inferred_k) {
+    double p[2];
+    bool lg[2];
+    f_kind kinds[2] = { current, inferred };
+    double ks[2] = { current_k, inferred_k };
+    for (int i = 0; i < 2; i++) {
+        switch (kinds[i]) {
+            case F_LOG:   p[i] = 0.0; lg[i] = true; break;
+            case F_N:     p[i] = 1.0; lg[i] = false; break;
+            case F_NK:    p[i] = ks[i]; lg[i] = false; break;
+            case F_NLOGN: p[i] = 1.0; lg[i] = true; break;
+            default:      p[i] = 0.0; lg[i] = false; break;
+        }
+    }
+    if (p[1] > p[0]) return true;
+    return fabs(p[1] - p[0]) < 1e-9 && lg[1] && !lg[0];
+}
+
+/* --------------------------- solvers --------------------------- */
+
+static json_t *error_obj(const char *msg) {
+    json_t *o = json_object();
+    json_object_set_new(o, "error", json_string(msg));
+    return o;
+}
+
+static json_t *unsupported_f(const char *f_expr) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "Unsupported f(n): %s", f_expr);
+    return error_obj(buf);
+}
+
+static json_t *solution_obj(const char *recurrence, const char *solution, json_t *lines) {
+    json_t *o = json_object();
+    json_object_set_new(o, "recurrence", json_string(recurrence));
+    json_object_set_new(o, "solution", json_string(solution));
+    json_object_set_new(o, "case_reasoning", lines);
+    return o;
+}
+
+// T(n) = a T(n/b) + f(n)
+static json_t *solve_master_theorem(const json_t *a_v, const json_t *b_v, const char *f_expr) {
+    double a, b, k;
+    if (!is_number(a_v, &a) || !is_number(b_v, &b) || a <= 0) return error_obj("Invalid a or b.");
+    if (b <= 1) return error_obj("Master Theorem requires b > 1.");
+    f_kind kind = classify_f(f_expr, &k);
+    if (kind == F_UNSUPPORTED) return unsupported_f(f_expr);
+
+    char as[40], bs[40], e[40], sol[96], rec[256];
+    py_str(a_v, as, sizeof(as));
+    py_str(b_v, bs, sizeof(bs));
+    double log_ab = log(a) / log(b);
+    json_t *lines = json_array();
+    snprintf(rec, sizeof(rec), "T(n) = %sT(n/%s) + %s", as, bs, f_expr);
+    append(lines, "%s", rec);
+    append(lines, "log_b(a) = log_%s(%s) = %.2f", bs, as, log_ab);
+
+    if (kind == F_LOG) {
+        fmt_exp(log_ab, e, sizeof(e));
+        snprintf(sol, sizeof(sol), "O(n^%s)", e);
+        append(lines, "Case 1: f(n) = o(n^{log_b(a)}).");
+    } else if (kind == F_NLOGN) {
+        if (fabs(log_ab - 1.0) < 1e-9) {
+            snprintf(sol, sizeof(sol), "O(n log n)");
+            append(lines, "Case 2: f(n) = Θ(n^{log_b(a)} · log n).");
+        } else if (log_ab < 1.0) {
+            snprintf(sol, sizeof(sol), "O(n log n)");
+            append(lines, "Case 3: f(n) = Ω(n^{log_b(a)}), regularity assumed.");
+        } else {
+            fmt_exp(log_ab, e, sizeof(e));
+            snprintf(sol, sizeof(sol), "O(n^%s)", e);
+            append(lines, "Case 1: n^{log_b(a)} dominates.");
+        }
+    } else {
+        double f_pow = kind == F_CONST ? 0.0 : kind == F_N ? 1.0 : k;
+        if (f_pow < log_ab - 1e-9) {
+            fmt_exp(log_ab, e, sizeof(e));
+            snprintf(sol, sizeof(sol), "O(n^%s)", e);
+            append(lines, "Case 1: f(n) = o(n^{log_b(a)}).");
+        } else if (fabs(f_pow - log_ab) <= 1e-9) {
+            fmt_exp(f_pow, e, sizeof(e));
+            snprintf(sol, sizeof(sol), "O(n^%s log n)", e);
+            append(lines, "Case 2: f(n) = Θ(n^{log_b(a)}).");
+        } else {
+            fmt_exp(f_pow, e, sizeof(e));
+            snprintf(sol, sizeof(sol), "O(n^%s)", e);
+            append(lines, "Case 3: f(n) = Ω(n^{log_b(a)}), regularity assumed.");
+        }
+    }
+    return solution_obj(rec, sol, lines);
+}
+
+// T(n) = a T(n-c) + f(n)
+static json_t *solve_decrease(const json_t *a_v, const json_t *c_v, const char *f_expr) {
+    double a, c, k;
+    if (!is_number(a_v, &a) || !is_number(c_v, &c)) return error_obj("Invalid a or c.");
+    if (a < 1 || c < 1) return error_obj("Decrease model requires a >= 1 and c >= 1.");
+    f_kind kind = classify_f(f_expr, &k);
+    if (kind == F_UNSUPPORTED) return unsupported_f(f_expr);
+
+    char as[40], cs[40], e[40], sol[128], rec[256];
+    py_str(a_v, as, sizeof(as));
+    py_str(c_v, cs, sizeof(cs));
+    json_t *lines = json_array();
+    snprintf(rec, sizeof(rec), "T(n) = %sT(n-%s) + %s", as, cs, f_expr);
+    append(lines, "%s", rec);
+    if (a == 1) {
+        switch (kind) {
+            case F_CONST: snprintf(sol, sizeof(sol), "O(n)"); break;
+            case F_LOG:   snprintf(sol, sizeof(sol), "O(n log n)"); break;
+            case F_N:     snprintf(sol, sizeof(sol), "O(n^2)"); break;
+            case F_NK:    fmt_exp(k + 1.0, e, sizeof(e)); snprintf(sol, sizeof(sol), "O(n^%s)", e); break;
+            default:      snprintf(sol, sizeof(sol), "O(n^2 log n)"); break;
+        }
+        append(lines, "a = 1: n/%s levels of f(n) work each, so T(n) = Θ(n · f(n)).", cs);
+    } else {
+        if (c == 1) snprintf(sol, sizeof(sol), "O(%s^n)", as);
+        else snprintf(sol, sizeof(sol), "O(%s^(n/%s))", as, cs);
+        append(lines, "a > 1: the call tree has %s^(n/%s) leaves, which dominates any polynomial f(n).", as, cs);
+    }
+    return solution_obj(rec, sol, lines);
+}
+
+/* --------------------------- recurrence terms --------------------------- */
+
+#define TERM_LIMIT 1000000  // counts and sizes past this are not a recurrence worth solving
+#define MAX_TERMS 8         // distinct sizes, as many as the parser reports
+
+// one term of the key: a T(num·n/den), or a T(n-c) when c > 0
+typedef struct { long long num, den, c, a; } term_t;
+
+typedef struct {
+    term_t t[MAX_TERMS];
+    size_t n;
+} term_key;
+
+static bool int_in(const json_t *v, long long lo, long long hi, long long *out) {
+    if (!json_is_integer(v)) return false;
+    *out = (long long)json_integer_value(v);
+    return *out >= lo && *out <= hi;
+}
+
+static long long gcd_ll(long long a, long long b) {
+    while (b) { long long t = a % b; a = b; b = t; }
+    return a;
+}
+
+static int cmp_term(const void *x, const void *y) {
+    const term_t *a = (const term_t*)x, *b = (const term_t*)y;
+    if (a->num != b->num) return a->num < b->num ? -1 : 1;
+    if (a->den != b->den) return a->den < b->den ? -1 : 1;
+    return (a->c > b->c) - (a->c < b->c);
+}
+
+// the parser's "terms", fractions reduced and equal sizes merged; false unless all valid and of one kind
+static bool normalize_terms(const json_t *terms, term_key *K) {
+    K->n = 0;
+    if (!json_is_array(terms) || json_array_size(terms) == 0) return false;
+    bool too_many = false;
+    size_t i;
+    json_t *t;
+    json_array_foreach(terms, i, t) {
+        long long a, num = 0, den = 0, c = 0;
+        if (!json_is_object(t) || !int_in(json_object_get(t, "a"), 1, TERM_LIMIT, &a)) return false;
+        const json_t *cv = json_object_get(t, "c");
+        if (cv) {
+            if (!int_in(cv, 1, TERM_LIMIT, &c)) return false;
+        } else {
+            if (!int_in(json_object_get(t, "num"), 1, TERM_LIMIT, &num) ||
+                !int_in(json_object_get(t, "den"), 1, TERM_LIMIT, &den) || num >= den) return false;
+            long long g = gcd_ll(num, den);
+            num /= g;
+            den /= g;
+        }
+        size_t j = 0;
+        while (j < K->n && !(K->t[j].num == num && K->t[j].den == den && K->t[j].c == c)) j++;
+        if (j < K->n) K->t[j].a += a;
+        else if (K->n == MAX_TERMS) too_many = true;
+        else K->t[K->n++] = (term_t){ num, den, c, a };
+    }
+    if (too_many) return false;
+    for (size_t j = 1; j < K->n; j++) if ((K->t[j].c > 0) != (K->t[0].c > 0)) return false;
+    qsort(K->t, K->n, sizeof(term_t), cmp_term);
+    return true;
+}
+
+// the recursive part of T(n), e.g. "T(n/3) + T(2n/3)"
+static void fmt_calls(const term_key *K, char *out, size_t n) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < K->n && used < n; i++) {
+        const term_t *t = &K->t[i];
+        char a[24] = "", arg[64];
+        if (t->a != 1) snprintf(a, sizeof(a), "%lld", t->a);
+        if (t->c) snprintf(arg, sizeof(arg), "n-%lld", t->c);
+        else if (t->num == 1) snprintf(arg, sizeof(arg), "n/%lld", t->den);
+        else snprintf(arg, sizeof(arg), "%lldn/%lld", t->num, t->den);
+        int w = snprintf(out + used, n - used, "%s%sT(%s)", i ? " + " : "", a, arg);
+        if (w > 0) used += (size_t)w;
+    }
+}
+
+// O(n^p log^q n), written the way the Master Theorem solver writes it
+static void fmt_growth(double p, long long q, char *out, size_t n) {
+    char logs[32] = "", e[40];
+    if (q == 1) snprintf(logs, sizeof(logs), "log n");
+    else if (q > 1) snprintf(logs, sizeof(logs), "log^%lld n", q);
+    if (fabs(p) < 1e-9) { snprintf(out, n, "O(%s)", *logs ? logs : "1"); return; }
+    fmt_exp(p, e, sizeof(e));
+    snprintf(out, n, "O(n^%s%s%s)", e, *logs ? " " : "", logs);
+}
+
+static double snap(double x) {
+    double r = nearbyint(x);
+    return fabs(x - r) < 1e-9 ? r : x;
+}
+
+// sum a_i (num_i/den_i)^p, or sum a_i x^-c_i for the linear terms
+static double term_sum(const term_key *K, double x) {
+    double s = 0;
+    for (size_t i = 0; i < K->n; i++) {
+        const term_t *t = &K->t[i];
+        s += t->c ? (double)t->a * pow(x, -(double)t->c) : (double)t->a * pow((double)t->num / (double)t->den, x);
+    }
+    return s;
+}
+
+// where the decreasing term_sum falls through 1 in [lo, hi], by bisection
+static double crossing(const term_key *K, double lo, double hi) {
+    for (int i = 0; i < 200; i++) {
+        double mid = (lo + hi) / 2;
+        if (term_sum(K, mid) > 1) lo = mid;
+        else hi = mid;
+    }
+    return snap((lo + hi) / 2);
+}
+
+static json_t *solve_terms_uncached(const term_key *K, const char *f_expr) {
+    double k, f_pow;
+    long long f_logs;
+    switch (classify_f(f_expr, &k)) {
+        case F_CONST: f_pow = 0.0; f_logs = 0; break;
+        case F_LOG:   f_pow = 0.0; f_logs = 1; break;
+        case F_N:     f_pow = 1.0; f_logs = 0; break;
+        case F_NK:    f_pow = k;   f_logs = 0; break;
+        case F_NLOGN: f_pow = 1.0; f_logs = 1; break;
+        default:      return unsupported_f(f_expr);
+    }
+
+    char calls[512], rec[768], eq[512], sol[96];
+    size_t used = 0;
+    fmt_calls(K, calls, sizeof(calls));
+    snprintf(rec, sizeof(rec), "T(n) = %s + %s", calls, f_expr);
+    json_t *lines = json_array();
+    append(lines, "%s", rec);
+    eq[0] = '\0';
+    if (K->t[0].c == 0) {
+        // Akra-Bazzi: sum a_i b_i^p = 1, then compare f(n) with n^p
+        double hi = 1.0;
+        while (term_sum(K, hi) > 1 && hi < 1024) hi *= 2;
+        double p = crossing(K, 0.0, hi);
+        for (size_t i = 0; i < K->n && used < sizeof(eq); i++) {
+            char a[24] = "";
+            if (K->t[i].a != 1) snprintf(a, sizeof(a), "%lld", K->t[i].a);
+            int w = snprintf(eq + used, sizeof(eq) - used, "%s%s(%lld/%lld)^p", i ? " + " : "", a, K->t[i].num, K->t[i].den);
+            if (w > 0) used += (size_t)w;
+        }
+        append(lines, "Akra-Bazzi: p = %.2f solves %s = 1", p, eq);
+        if (f_pow < p - 1e-9) {
+            fmt_growth(p, 0, sol, sizeof(sol));
+            append(lines, "Case 1: f(n) = O(n^(p-ε)), so T(n) = Θ(n^p).");
+        } else if (fabs(f_pow - p) <= 1e-9) {
+            fmt_growth(p, f_logs + 1, sol, sizeof(sol));
+            append(lines, "Case 2: f(n) = Θ(n^p log^q n), so T(n) = Θ(n^p log^(q+1) n).");
+        } else {
+            fmt_growth(f_pow, f_logs, sol, sizeof(sol));
+            append(lines, "Case 3: f(n) = Ω(n^(p+ε)), so T(n) = Θ(f(n)).");
+        }
+    } else {
+        // linear: the characteristic root, sum a_i r^-c_i = 1, is > 1 and its r^n dominates f(n)
+        long long total = 0;
+        for (size_t i = 0; i < K->n; i++) total += K->t[i].a;
+        if (total < 2) {
+            json_decref(lines);
+            return error_obj("A single T(n-c) term is the decrease model.");
+        }
+        double r = crossing(K, 1.0, (double)total);
+        for (size_t i = 0; i < K->n && used < sizeof(eq); i++) {
+            char a[24] = "";
+            if (K->t[i].a != 1) snprintf(a, sizeof(a), "%lld", K->t[i].a);
+            int w = snprintf(eq + used, sizeof(eq) - used, "%s%sr^-%lld", i ? " + " : "", a, K->t[i].c);
+            if (w > 0) used += (size_t)w;
+        }
+        char e[40];
+        fmt_exp(r, e, sizeof(e));
+        snprintf(sol, sizeof(sol), "O(%s^n)", e);
+        append(lines, "characteristic root r = %.2f solves %s = 1", r, eq);
+        append(lines, "r > 1: the r^n solution of the homogeneous part dominates any polynomial f(n).");
+    }
+    return solution_obj(rec, sol, lines);
+}
+
+/* Solved shapes, so each is bisected once: direct-mapped by the hash of
+   the key text, answers handed out as copies (the functools.lru_cache on
+   solve_terms_key in app.py). */
+#define TERMS_MEMO_SLOTS 256
+
+static struct { char *key; json_t *answer; } terms_memo[TERMS_MEMO_SLOTS];
+static pthread_mutex_t terms_memo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* T(n) = sum a_i T(b_i n) + f(n) by Akra-Bazzi, or T(n) = sum a_i T(n-c_i) + f(n)
+   by its characteristic root */
+static json_t *solve_terms(const term_key *K, const char *f_expr) {
+    char key[1024];
+    size_t used = 0;
+    for (size_t i = 0; i < K->n && used < sizeof(key); i++) {
+        int w = snprintf(key + used, sizeof(key) - used, "%lld/%lld-%lld*%lld;", K->t[i].num, K->t[i].den, K->t[i].c, K->t[i].a);
+        if (w > 0) used += (size_t)w;
+    }
+    if (used < sizeof(key)) snprintf(key + used, sizeof(key) - used, "%s", f_expr);
+    uint64_t h = 1469598103934665603ull;  // FNV-1a
+    for (const unsigned char *p = (const unsigned char*)key; *p; p++) { h ^= *p; h *= 1099511628211ull; }
+    size_t slot = (size_t)(h % TERMS_MEMO_SLOTS);
+
+    json_t *answer = NULL;
+    pthread_mutex_lock(&terms_memo_lock);
+    if (terms_memo[slot].key && strcmp(terms_memo[slot].key, key) == 0) answer = json_deep_copy(terms_memo[slot].answer);
+    pthread_mutex_unlock(&terms_memo_lock);
+    if (answer) return answer;
+
+    answer = solve_terms_uncached(K, f_expr);
+    char *k = strdup(key);
+    json_t *copy = json_deep_copy(answer);
+    if (!k || !copy) { free(k); json_decref(copy); return answer; }
+    pthread_mutex_lock(&terms_memo_lock);
+    free(terms_memo[slot].key);
+    json_decref(terms_memo[slot].answer);
+    terms_memo[slot].key = k;
+    terms_memo[slot].answer = copy;
+    pthread_mutex_unlock(&terms_memo_lock);
+    return answer;
+}
+
+/* --------------------------- loop nest --------------------------- */
+
+// a trip count or a nest's cost: n^p log^q n
+typedef struct { long long p, q; } cost_t;
+
+static bool cost_less(cost_t a, cost_t b) { return a.p < b.p || (a.p == b.p && a.q < b.q); }
+
+static bool is_str(const json_t *v, const char *s) { return json_is_string(v) && strcmp(json_string_value(v), s) == 0; }
+
+static bool starts_log(const json_t *bound) {
+    return json_is_string(bound) && strncmp(json_string_value(bound), "log ", 4) == 0;
+}
+
+static cost_t loop_factor(const json_t *loop) {
+    const json_t *growth = json_object_get(loop, "growth");
+    if (is_str(growth, "constant")) return (cost_t){0, 0};
+    if (is_str(growth, "log") || (is_str(growth, "dependent") && starts_log(json_object_get(loop, "bound"))))
+        return (cost_t){0, 1};
+    return (cost_t){1, 0};
+}
+
+static bool sums_to_linear(const json_t *outer, const json_t *inner) {
+    const json_t *var = json_object_get(outer, "var");
+    const json_t *dep = json_object_get(inner, "dependsOn");
+    return is_str(json_object_get(outer, "growth"), "log") && json_is_string(var) && json_string_length(var) > 0
+        && is_str(json_object_get(inner, "growth"), "dependent")
+        && json_is_string(dep) && strcmp(json_string_value(dep), json_string_value(var)) == 0
+        && !starts_log(json_object_get(inner, "bound"));
+}
+
+// the loop objects of an array, non-objects skipped, with their parents
+typedef struct {
+    const json_t **items;
+    long long *parents;   // -1 at the top
+    size_t n;
+} loop_nest;
+
+static void nest_free(loop_nest *N) {
+    free(N->items);
+    free(N->parents);
+    *N = (loop_nest){0};
+}
+
+// own_loops() and loop_parents(); false when out of memory
+static bool loop_parents(const json_t *loops, loop_nest *N) {
+    size_t n = 0, i;
+    json_t *l;
+    json_array_foreach(loops, i, l) n += json_is_object(l);
+    *N = (loop_nest){0};
+    N->items = (const json_t**)malloc((n ? n : 1) * sizeof(*N->items));
+    N->parents = (long long*)malloc((n ? n : 1) * sizeof(*N->parents));
+    size_t *open_ = (size_t*)malloc((n ? n : 1) * sizeof(*open_));
+    bool ok = N->items && N->parents && open_;
+    if (ok) {
+        size_t nopen = 0;
+        json_array_foreach(loops, i, l) {
+            if (!json_is_object(l)) continue;
+            const json_t *d = json_object_get(l, "depth");
+            long long depth = truthy(d) ? (long long)num_or_zero(d) : 1;
+            if (depth < 1) depth = 1;
+            if ((unsigned long long)(depth - 1) < nopen) nopen = (size_t)(depth - 1);  // del open_[depth-1:]
+            N->parents[N->n] = nopen ? (long long)open_[nopen-1] : -1;
+            open_[nopen++] = N->n;
+            N->items[N->n++] = l;
+        }
+    } else {
+        nest_free(N);
+    }
+    free(open_);
+    return ok;
+}
+
+// false when out of memory
+static bool loop_cost(const loop_nest *N, cost_t *out) {
+    cost_t *cost = (cost_t*)malloc((N->n ? N->n : 1) * sizeof(*cost));
+    if (!cost) return false;
+    for (size_t j = 0; j < N->n; j++) cost[j] = loop_factor(N->items[j]);
+    cost_t best = {0, 0};
+    for (size_t j = N->n; j-- > 0; ) {
+        long long p = N->parents[j];
+        if (p < 0) {
+            if (cost_less(best, cost[j])) best = cost[j];
+            continue;
+        }
+        cost_t pair = cost[j];
+        if (!sums_to_linear(N->items[p], N->items[j])) {
+            cost_t f = loop_factor(N->items[p]);
+            pair.p += f.p;
+            pair.q += f.q;
+        }
+        if (cost_less(cost[p], pair)) cost[p] = pair;
+    }
+    free(cost);
+    *out = best;
+    return true;
+}
+
+static cost_t enclosed_cost(const loop_nest *N, long long k, cost_t inner) {
+    long long child = -1;
+    while (k >= 0) {
+        if (child < 0 || !sums_to_linear(N->items[k], N->items[child])) {
+            cost_t f = loop_factor(N->items[k]);
+            inner.p += f.p;
+            inner.q += f.q;
+        }
+        child = k;
+        k = N->parents[k];
+    }
+    return inner;
+}
+
+static void fmt_cost(cost_t c, char *out, size_t n) {
+    char logs[48];
+    if (c.q == 1) snprintf(logs, sizeof(logs), "log n");
+    else snprintf(logs, sizeof(logs), "log^%lld n", c.q);
+    if (c.p == 0) snprintf(out, n, c.q ? "O(%s)" : "O(1)", logs);
+    else if (c.q) snprintf(out, n, "O(n^%lld %s)", c.p, logs);
+    else snprintf(out, n, "O(n^%lld)", c.p);
+}
+
+/* --------------------------- call graph --------------------------- */
+
+typedef struct {
+    const json_t **fns;     // functions with a string name
+    size_t n;
+    size_t *slots;          // open addressing by name: 1 + index of the last function so named, 0 = empty
+    size_t nslots;          // a power of two
+    loop_nest *nests;       // own loops of each function
+    size_t *site_off;       // function v calls site_fn[site_off[v] .. site_off[v+1]) ...
+    size_t *site_fn;
+    long long *site_loop;   // ... from inside these loops of its nest, -1 = none
+    // filled in by function_costs()
+    size_t *members;        // component c is members[scc_off[c] .. scc_off[c+1]), sorted
+    size_t *scc_off;
+    size_t nsccs;
+    cost_t *cost;
+} call_graph;
+
+static const char *fn_name(const call_graph *G, size_t v) {
+    return json_string_value(json_object_get(G->fns[v], "name"));
+}
+
+static size_t *name_slot(const call_graph *G, const char *name) {
+    uint64_t h = 1469598103934665603ull;  // FNV-1a
+    for (const unsigned char *p = (const unsigned char*)name; *p; p++) { h ^= *p; h *= 1099511628211ull; }
+    for (size_t i = (size_t)h & (G->nslots - 1);; i = (i + 1) & (G->nslots - 1)) {
+        size_t v = G->slots[i];
+        if (!v || strcmp(fn_name(G, v - 1), name) == 0) return &G->slots[i];
+    }
+}
+
+// index of the function named name, -1 if there is none
+static long long function_index(const call_graph *G, const json_t *name) {
+    if (!json_is_string(name)) return -1;
+    size_t v = *name_slot(G, json_string_value(name));
+    return v ? (long long)v - 1 : -1;
+}
+
+static void call_graph_free(call_graph *G) {
+    if (G->nests) for (size_t v = 0; v < G->n; v++) nest_free(&G->nests[v]);
+    free(G->fns);
+    free(G->slots);
+    free(G->nests);
+    free(G->site_off);
+    free(G->site_fn);
+    free(G->site_loop);
+    free(G->members);
+    free(G->scc_off);
+    free(G->cost);
+    *G = (call_graph){0};
+}
+
+// false for summaries without per-function loops, or out of memory
+static bool call_graph_build(const json_t *summary, call_graph *G) {
+    *G = (call_graph){0};
+    const json_t *functions = get(summary, "functions");
+    size_t n = 0, nsites = 0, i;
+    bool has_loops = false;
+    json_t *f;
+    json_array_foreach(functions, i, f) {
+        if (!json_is_object(f) || !json_is_string(json_object_get(f, "name"))) continue;
+        n++;
+        has_loops |= json_is_array(json_object_get(f, "loops"));
+        nsites += json_array_size(json_object_get(f, "callSites"));
+    }
+    if (!has_loops) return false;
+    G->nslots = 8;
+    while (G->nslots < 2 * n) G->nslots *= 2;
+    G->fns = (const json_t**)malloc(n * sizeof(*G->fns));
+    G->slots = (size_t*)calloc(G->nslots, sizeof(*G->slots));
+    G->nests = (loop_nest*)calloc(n, sizeof(*G->nests));
+    G->site_off = (size_t*)malloc((n + 1) * sizeof(*G->site_off));
+    G->site_fn = (size_t*)malloc((nsites ? nsites : 1) * sizeof(*G->site_fn));
+    G->site_loop = (long long*)malloc((nsites ? nsites : 1) * sizeof(*G->site_loop));
+    if (!G->fns || !G->slots || !G->nests || !G->site_off || !G->site_fn || !G->site_loop) {
+        call_graph_free(G);
+        return false;
+    }
+    json_array_foreach(functions, i, f) {
+        if (!json_is_object(f) || !json_is_string(json_object_get(f, "name"))) continue;
+        G->fns[G->n] = f;
+        *name_slot(G, json_string_value(json_object_get(f, "name"))) = ++G->n;
+    }
+    size_t k = 0;
+    for (size_t v = 0; v < n; v++) {
+        G->site_off[v] = k;
+        if (!loop_parents(json_object_get(G->fns[v], "loops"), &G->nests[v])) {
+            call_graph_free(G);
+            return false;
+        }
+        json_t *s;
+        json_array_foreach(json_object_get(G->fns[v], "callSites"), i, s) {
+            long long w = json_is_object(s) ? function_index(G, json_object_get(s, "name")) : -1;
+            if (w < 0) continue;
+            const json_t *loop = json_object_get(s, "loop");
+            long long at = json_is_integer(loop) ? (long long)json_integer_value(loop) : -1;
+            if (at < 0 || (unsigned long long)at >= G->nests[v].n) at = -1;
+            G->site_fn[k] = (size_t)w;
+            G->site_loop[k++] = at;
+        }
+    }
+    G->site_off[n] = k;
+    return true;
+}
+
+static int cmp_size(const void *a, const void *b) {
+    size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Tarjan's components without recursion, callees first; false when out of memory
+static bool strongly_connected(call_graph *G) {
+    size_t n = G->n;
+    long long *order = (long long*)malloc((n ? n : 1) * sizeof(*order));
+    long long *low = (long long*)malloc((n ? n : 1) * sizeof(*low));
+    bool *on_stack = (bool*)calloc(n ? n : 1, sizeof(*on_stack));
+    size_t *stack = (size_t*)malloc((n ? n : 1) * sizeof(*stack));
+    size_t *work_v = (size_t*)malloc((n ? n : 1) * sizeof(*work_v));
+    size_t *work_k = (size_t*)malloc((n ? n : 1) * sizeof(*work_k));
+    G->members = (size_t*)malloc((n ? n : 1) * sizeof(*G->members));
+    G->scc_off = (size_t*)malloc((n + 1) * sizeof(*G->scc_off));
+    bool ok = order && low && on_stack && stack && work_v && work_k && G->members && G->scc_off;
+    if (ok) {
+        size_t sp = 0, nm = 0, nc = 0;
+        long long counter = 0;
+        for (size_t v = 0; v < n; v++) order[v] = -1;
+        for (size_t root = 0; root < n; root++) {
+            if (order[root] >= 0) continue;
+            size_t wp = 1;
+            work_v[0] = root;
+            work_k[0] = 0;
+            while (wp) {
+                size_t v = work_v[wp-1], k = work_k[wp-1];
+                if (k == 0) {
+                    order[v] = low[v] = counter++;
+                    stack[sp++] = v;
+                    on_stack[v] = true;
+                }
+                if (k < G->site_off[v+1] - G->site_off[v]) {
+                    work_k[wp-1] = k + 1;
+                    size_t w = G->site_fn[G->site_off[v] + k];
+                    if (order[w] < 0) { work_v[wp] = w; work_k[wp] = 0; wp++; }
+                    else if (on_stack[w] && order[w] < low[v]) low[v] = order[w];
+                    continue;
+                }
+                wp--;
+                if (wp && low[v] < low[work_v[wp-1]]) low[work_v[wp-1]] = low[v];
+                if (low[v] == order[v]) {
+                    G->scc_off[nc] = nm;
+                    size_t w;
+                    do {
+                        w = stack[--sp];
+                        on_stack[w] = false;
+                        G->members[nm++] = w;
+                    } while (w != v);
+                    qsort(G->members + G->scc_off[nc], nm - G->scc_off[nc], sizeof(size_t), cmp_size);
+                    nc++;
+                }
+            }
+        }
+        G->scc_off[nc] = nm;
+        G->nsccs = nc;
+    }
+    free(order);
+    free(low);
+    free(on_stack);
+    free(stack);
+    free(work_v);
+    free(work_k);
+    return ok;
+}
+
+// G->cost of every function, callees first; false when out of memory
+static bool function_costs(call_graph *G) {
+    if (!strongly_connected(G)) return false;
+    size_t *comp = (size_t*)malloc((G->n ? G->n : 1) * sizeof(*comp));
+    G->cost = (cost_t*)calloc(G->n ? G->n : 1, sizeof(*G->cost));
+    if (!comp || !G->cost) { free(comp); return false; }
+    for (size_t c = 0; c < G->nsccs; c++)
+        for (size_t m = G->scc_off[c]; m < G->scc_off[c+1]; m++) comp[G->members[m]] = c;
+    bool ok = true;
+    for (size_t m = 0; m < G->n && ok; m++) {
+        size_t v = G->members[m];
+        cost_t best;
+        ok = loop_cost(&G->nests[v], &best);
+        for (size_t s = G->site_off[v]; ok && s < G->site_off[v+1]; s++) {
+            size_t w = G->site_fn[s];
+            if (comp[w] == comp[v]) continue;
+            cost_t c = enclosed_cost(&G->nests[v], G->site_loop[s], G->cost[w]);
+            if (cost_less(best, c)) best = c;
+        }
+        G->cost[v] = best;
+    }
+    free(comp);
+    return ok;
+}
+
+/* --------------------------- extraction --------------------------- */
+
+typedef struct {
+    const json_t *a, *b, *f;   // b is c for the decrease model
+    const char *src;
+    const json_t *function;    // may be NULL
+} found_rec;
+
+static bool extract_recurrence(const json_t *doc, found_rec *out) {
+    static const char *const abf[] = { "a", "b", "f", NULL };
+    const json_t *r = get(doc, "recurrence");
+    const char *src = "recurrence";
+    const json_t *summary = get(doc, "summary");
+    if (!(json_is_object(r) && has_keys(r, abf))) {
+        r = get(summary, "recurrence");
+        src = "summary.recurrence";
+    }
+    if (!(json_is_object(r) && has_keys(r, abf))) {
+        r = NULL;
+        const json_t *recs = get(summary, "recurrences");
+        const json_t *only = NULL;
+        size_t n = 0, i;
+        json_t *v;
+        json_array_foreach(recs, i, v) if (json_is_object(v)) { only = v; n++; }
+        if (n == 1 && has_keys(only, abf)) { r = only; src = "summary.recurrences[0]"; }
+    }
+    if (r) {
+        *out = (found_rec){ json_object_get(r, "a"), json_object_get(r, "b"), json_object_get(r, "f"), src,
+                            json_object_get(r, "function") };
+        return true;
+    }
+
+    const json_t *match = NULL, *match_fn = NULL;
+    size_t n = 0, i;
+    json_t *fn;
+    json_array_foreach(get(summary, "functions"), i, fn) {
+        const json_t *fr = get(fn, "recurrence");
+        if (json_is_object(fr) && has_keys(fr, abf)) { match = fr; match_fn = fn; n++; }
+    }
+    if (n != 1) return false;
+    *out = (found_rec){ json_object_get(match, "a"), json_object_get(match, "b"), json_object_get(match, "f"),
+                        "summary.functions[*].recurrence", json_object_get(match_fn, "name") };
+    return true;
+}
+
+static bool is_decrease(const json_t *r) {
+    static const char *const acf[] = { "a", "c", "f", NULL };
+    const json_t *model = get(r, "model");
+    return json_is_object(r) && json_is_string(model) && strcmp(json_string_value(model), "decrease") == 0 &&
+           has_keys(r, acf) && !json_object_get(r, "b");
+}
+
+static bool extract_decrease(const json_t *summary, found_rec *out) {
+    const json_t *only = NULL;
+    size_t n = 0, i;
+    json_t *v;
+    json_array_foreach(get(summary, "recurrences"), i, v) if (json_is_object(v)) { only = v; n++; }
+    if (n == 1 && is_decrease(only)) {
+        *out = (found_rec){ json_object_get(only, "a"), json_object_get(only, "c"), json_object_get(only, "f"),
+                            "summary.recurrences[0]", json_object_get(only, "function") };
+        return true;
+    }
+
+    const json_t *match = NULL, *match_fn = NULL;
+    n = 0;
+    json_array_foreach(get(summary, "functions"), i, v) {
+        if (json_is_object(v) && is_decrease(json_object_get(v, "recurrence"))) { match = json_object_get(v, "recurrence"); match_fn = v; n++; }
+    }
+    if (n != 1) return false;
+    *out = (found_rec){ json_object_get(match, "a"), json_object_get(match, "c"), json_object_get(match, "f"),
+                        "summary.functions[*].recurrence", json_object_get(match_fn, "name") };
+    return true;
+}
+
+// terms beyond the Master Theorem and the decrease model: several sizes, or num·n/den with num > 1
+static bool beyond_single(const json_t *r, term_key *K) {
+    return json_is_object(r) && json_is_string(json_object_get(r, "f")) &&
+           normalize_terms(json_object_get(r, "terms"), K) && (K->n > 1 || K->t[0].num > 1);
+}
+
+static bool extract_terms(const json_t *summary, term_key *K, found_rec *out) {
+    const json_t *only = NULL;
+    size_t n = 0, i;
+    json_t *v;
+    json_array_foreach(get(summary, "recurrences"), i, v) if (json_is_object(v)) { only = v; n++; }
+    if (n == 1 && beyond_single(only, K)) {
+        *out = (found_rec){ NULL, NULL, json_object_get(only, "f"), "summary.recurrences[0]", json_object_get(only, "function") };
+        return true;
+    }
+
+    const json_t *match = NULL, *match_fn = NULL;
+    term_key scratch;
+    n = 0;
+    json_array_foreach(get(summary, "functions"), i, v) {
+        if (json_is_object(v) && beyond_single(json_object_get(v, "recurrence"), &scratch)) {
+            match = json_object_get(v, "recurrence");
+            match_fn = v;
+            *K = scratch;
+            n++;
+        }
+    }
+    if (n != 1) return false;
+    *out = (found_rec){ NULL, NULL, json_object_get(match, "f"), "summary.functions[*].recurrence", json_object_get(match_fn, "name") };
+    return true;
+}
+
+// the one recursive function, if there is exactly one
+static const json_t *pick_recursive_function_name(const json_t *summary) {
+    const json_t *name = NULL;
+    size_t n = 0, i;
+    json_t *f;
+    json_array_foreach(get(summary, "functions"), i, f) {
+        if (json_is_object(f) && truthy(json_object_get(f, "is_recursive"))) { name = json_object_get(f, "name"); n++; }
+    }
+    return n == 1 ? name : NULL;
+}
+
+// {f.get("name"): f for f in functions}: the last function with that name
+static const json_t *function_named(const json_t *summary, const json_t *name) {
+    const json_t *found = NULL;
+    size_t i;
+    json_t *f;
+    json_array_foreach(get(summary, "functions"), i, f) {
+        if (!json_is_object(f)) continue;
+        const json_t *fname = json_object_get(f, "name");
+        if ((!fname && (!name || json_is_null(name))) || (fname && name && json_equal((json_t*)fname, (json_t*)name)))
+            found = f;
+    }
+    return found;
+}
+
+/* per-level work of func from its non-recursive callees: "1", "n" or "n^k"; false if unknown.
+   With a call graph (G may be NULL) a callee counts with everything it calls. */
+static bool infer_per_level_work(const json_t *summary, const json_t *func, const call_graph *G,
+                                 char *out, size_t n) {
+    if (!truthy(func)) return false;
+    const json_t *F = function_named(summary, func);
+    if (!truthy(F)) return false;
+
+    long long degree = 0;
+    size_t i;
+    json_t *callee;
+    json_array_foreach(json_object_get(F, "calls"), i, callee) {
+        const json_t *C = function_named(summary, callee);
+        if (!truthy(C) || truthy(json_object_get(C, "is_recursive"))) continue;
+        long long at = G ? function_index(G, callee) : -1;
+        if (at >= 0) { if (G->cost[at].p > degree) degree = G->cost[at].p; continue; }
+        double depth = num_or_zero(json_object_get(C, "maxLoopDepth"));
+        double loops = num_or_zero(json_object_get(C, "loopCount"));
+        if (depth >= 1) { if ((long long)depth > degree) degree = (long long)depth; continue; }
+        if (depth == 0 && loops > 0 && degree < 1) degree = 1;
+    }
+    if (degree <= 0) snprintf(out, n, "1");
+    else if (degree == 1) snprintf(out, n, "n");
+    else snprintf(out, n, "n^%lld", degree);
+    return true;
+}
+
+// the stronger of the parser's f(n) hint and the inferred one
+static bool upgrade_f_if_weaker(const char *provided, const char *inferred) {
+    double pk, ik;
+    f_kind p = classify_f(provided, &pk), i = classify_f(inferred, &ik);
+    if (p == F_UNSUPPORTED) return true;
+    if (i == F_UNSUPPORTED) return false;
+    return compare_growth(p, pk, i, ik);
+}
+
+/* --------------------------- analyze --------------------------- */
+
+json_t *solver_analyze(const json_t *doc) {
+    const json_t *summary = get(doc, "summary");
+    if (!json_is_object(summary)) return error_obj("invalid input");
+
+    // loop baseline
+    const json_t *loops = json_object_get(summary, "loops");
+    long long depth = 0;
+    size_t nloops = json_is_array(loops) ? json_array_size(loops) : 0, i;
+    json_t *l;
+    json_array_foreach(loops, i, l) {
+        const json_t *d = get(l, "depth");
+        long long v = truthy(d) ? (long long)num_or_zero(d) : 1;  // int(l.get("depth", 1) or 1)
+        if (v > depth) depth = v;
+    }
+    char headline[128];
+    if (depth > 0) snprintf(headline, sizeof(headline), "O(n^%lld)", depth);
+    else snprintf(headline, sizeof(headline), "O(1)");
+    json_t *expl = json_array();
+    append(expl, "Detected %zu loops; max depth = %lld", nloops, depth);
+    bool classified = false;
+    json_array_foreach(loops, i, l) classified |= json_is_object(l) && json_object_get(l, "growth");
+    cost_t base = {depth, 0};
+    loop_nest nest;
+    if (classified && loop_parents(loops, &nest)) {
+        cost_t cost;
+        if (loop_cost(&nest, &cost) && (cost.p != depth || cost.q != 0)) {
+            base = cost;
+            fmt_cost(cost, headline, sizeof(headline));
+            append(expl, "Loop bounds compose to %s", headline);
+        }
+        nest_free(&nest);
+    }
+
+    // call graph: costs propagated from callees to callers
+    call_graph graph;
+    bool have_graph = call_graph_build(summary, &graph);
+    if (have_graph && !function_costs(&graph)) {
+        call_graph_free(&graph);
+        have_graph = false;
+    }
+    if (have_graph) {
+        for (size_t c = 0; c < graph.nsccs; c++) {
+            if (graph.scc_off[c+1] - graph.scc_off[c] < 2) continue;
+            // any number of names, so not through append()
+            static const char lead[] = "mutually recursive: ";
+            size_t len = sizeof(lead) - 1;
+            for (size_t m = graph.scc_off[c]; m < graph.scc_off[c+1]; m++) len += strlen(fn_name(&graph, graph.members[m])) + 2;
+            char *line = (char*)malloc(len);
+            if (!line) continue;
+            size_t used = sizeof(lead) - 1;
+            memcpy(line, lead, used);
+            for (size_t m = graph.scc_off[c]; m < graph.scc_off[c+1]; m++) {
+                const char *nm = fn_name(&graph, graph.members[m]);
+                if (m > graph.scc_off[c]) { memcpy(line + used, ", ", 2); used += 2; }
+                memcpy(line + used, nm, strlen(nm));
+                used += strlen(nm);
+            }
+            json_array_append_new(expl, json_stringn(line, used));
+            free(line);
+        }
+        long long top = -1;
+        for (size_t v = 0; v < graph.n; v++) if (top < 0 || cost_less(graph.cost[top], graph.cost[v])) top = (long long)v;
+        if (top >= 0 && cost_less(base, graph.cost[top])) {
+            fmt_cost(graph.cost[top], headline, sizeof(headline));
+            append(expl, "Call graph: %s costs %s with its callees", fn_name(&graph, (size_t)top), headline);
+        }
+    }
+
+    // recursive functions
+    const json_t *functions = json_object_get(summary, "functions");
+    char names[512] = "";
+    size_t used = 0, nrec = 0;
+    long long total_loops = 0;
+    json_t *f;
+    json_array_foreach(functions, i, f) {
+        if (!json_is_object(f)) continue;
+        total_loops += (long long)num_or_zero(json_object_get(f, "loopCount"));
+        if (!truthy(json_object_get(f, "is_recursive"))) continue;
+        char nm[128];
+        py_str(json_object_get(f, "name"), nm, sizeof(nm));
+        int w = snprintf(names + used, sizeof(names) - used, "%s%s", nrec ? ", " : "", nm);
+        if (w > 0 && (size_t)w < sizeof(names) - used) used += (size_t)w;
+        nrec++;
+    }
+    if (nrec) append(expl, "recursive functions present: %s", names);
+    else append(expl, "no recursive functions detected");
+
+    /* 0) several recursive calls or a fraction other than n/b, else
+       1) a divide recurrence, else 1c) a decrease one; 0 only counts when it is solved */
+    json_t *recurrence_output = NULL;
+    found_rec rec = {0};
+    term_key terms;
+    for (int step = 0; step < 2 && !recurrence_output; step++) {
+        bool divide = false, found;
+        if (step == 0) found = extract_terms(summary, &terms, &rec);
+        else found = (divide = extract_recurrence(doc, &rec)) || extract_decrease(summary, &rec);
+        if (!found) continue;
+        char f_given[128], f_expr[128], inferred[32], note[512] = "";
+        py_str(rec.f, f_given, sizeof(f_given));
+        snprintf(f_expr, sizeof(f_expr), "%s", f_given);
+        const json_t *fn = truthy(rec.function) ? rec.function : pick_recursive_function_name(summary);
+        if (infer_per_level_work(summary, fn, have_graph ? &graph : NULL, inferred, sizeof(inferred)) && upgrade_f_if_weaker(f_expr, inferred)) {
+            char fname[128];
+            py_str(fn, fname, sizeof(fname));
+            snprintf(note, sizeof(note), "Adjusted f(n) from parser hint (%s) to inferred %s "
+                     "based on non-recursive callee loops (function: %s).", f_given, inferred, fname);
+            snprintf(f_expr, sizeof(f_expr), "%s", inferred);
+        }
+
+        recurrence_output = step == 0 ? solve_terms(&terms, f_expr)
+                          : divide ? solve_master_theorem(rec.a, rec.b, f_expr) : solve_decrease(rec.a, rec.b, f_expr);
+        const json_t *sol = json_object_get(recurrence_output, "solution");
+        if (sol) {
+            char as[40], bs[40], calls[512], lead[1024];
+            snprintf(headline, sizeof(headline), "%s", json_string_value(sol));
+            if (step == 0) {
+                fmt_calls(&terms, calls, sizeof(calls));
+                snprintf(lead, sizeof(lead), "Solved %s (from %s) %s, f(n)=%s",
+                         terms.t[0].c == 0 ? "via Akra-Bazzi" : "as a linear recurrence", rec.src, calls, f_expr);
+            } else {
+                py_str(rec.a, as, sizeof(as));
+                py_str(rec.b, bs, sizeof(bs));
+                if (divide) snprintf(lead, sizeof(lead), "Solved via Master Theorem (from %s) a=%s, b=%s, f(n)=%s", rec.src, as, bs, f_expr);
+                else snprintf(lead, sizeof(lead), "Solved as a decrease recurrence (from %s) a=%s, c=%s, f(n)=%s", rec.src, as, bs, f_expr);
+            }
+            if (*note) json_array_insert_new(expl, 0, json_string(note));
+            json_array_insert_new(expl, 0, json_string(lead));
+        } else if (step == 0) {
+            json_decref(recurrence_output);
+            recurrence_output = NULL;
+        }
+    }
+
+    // 2) no recurrence: recursion without loops is linear
+    if (!recurrence_output && nrec && total_loops == 0) {
+        snprintf(headline, sizeof(headline), "O(n)");
+        json_array_insert_new(expl, 0, json_string("Inferred recurrence: T(n)=T(n-1)+Θ(1) — no loops + recursion (linear fallback)."));
+        json_t *lines = json_array();
+        append(lines, "Linear recursion with constant work per step.");
+        recurrence_output = solution_obj("T(n)=T(n-1)+Θ(1)", "O(n)", lines);
+    }
+
+    if (have_graph) call_graph_free(&graph);
+
+    json_t *result = json_object();
+    json_object_set_new(result, "complexity", json_string(headline));
+    json_object_set_new(result, "explanation", expl);
+    if (recurrence_output) json_object_set_new(result, "recurrence_solution", recurrence_output);
+    return result;
+}
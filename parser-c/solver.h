@@ -0,0 +1,18 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <jansson.h>
+
+/* In-process port of the analyzer service (analyzer/app.py): loop
+   baseline composed from the loop bounds, call-graph cost propagation,
+   recurrence extraction, f(n) upgrade from non-recursive callees, the
+   Master Theorem for T(n)=aT(n/b)+f(n), the decrease model
+   T(n)=aT(n-c)+f(n), and from the parser's "terms" Akra-Bazzi for
+   T(n)=sum a_i T(b_i n)+f(n) and the characteristic root of
+   T(n)=sum a_i T(n-c_i)+f(n). `doc` is a parse document ({"summary": ...},
+   other members ignored); the result is the analyzer's answer object,
+   {"error":"invalid input"} when the document has no usable summary.
+   Changes to the rules must be made in both places. */
+json_t *solver_analyze(const json_t *doc);
+
+#endif
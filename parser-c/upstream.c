@@ -0,0 +1,284 @@
+#include "upstream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define UPSTREAM_MAX_HEAD  16384
+#define UPSTREAM_MAX_BODY  (16u << 20)
+
+static struct {
+    bool enabled;
+    char host[256];
+    char port[8];
+    char path[512];
+    int timeout_ms;
+} UP;
+
+static __thread int UP_FD = -1;  // this thread's keep-alive connection
+
+int upstream_init(const char *url, int timeout_ms) {
+    UP.enabled = false;
+    if (!url || strncmp(url, "http://", 7) != 0) return -1;
+    const char *host = url + 7;
+    size_t hlen = strcspn(host, ":/");
+    if (hlen == 0 || hlen >= sizeof(UP.host)) return -1;
+    memcpy(UP.host, host, hlen);
+    UP.host[hlen] = '\0';
+
+    const char *p = host + hlen;
+    snprintf(UP.port, sizeof(UP.port), "80");
+    if (*p == ':') {
+        size_t plen = strcspn(++p, "/");
+        if (plen == 0 || plen >= sizeof(UP.port)) return -1;
+        memcpy(UP.port, p, plen);
+        UP.port[plen] = '\0';
+        p += plen;
+    }
+    if (snprintf(UP.path, sizeof(UP.path), "%s", *p ? p : "/") >= (int)sizeof(UP.path)) return -1;
+    UP.timeout_ms = timeout_ms > 0 ? timeout_ms : 5000;
+    UP.enabled = true;
+    return 0;
+}
+
+bool upstream_enabled(void) { return UP.enabled; }
+
+void upstream_reply_free(upstream_reply *r) {
+    free(r->body);
+    r->body = NULL;
+    r->body_len = 0;
+}
+
+/* --------------------------- connection --------------------------- */
+
+static void set_timeouts(int fd) {
+    struct timeval tv = { .tv_sec = UP.timeout_ms / 1000, .tv_usec = (UP.timeout_ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// non-blocking connect bounded by the timeout, then back to blocking I/O
+static int connect_timeout(const struct addrinfo *ai) {
+    int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) return -1;
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(fd, ai->ai_addr, ai->ai_addrlen);
+    if (rc < 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        rc = poll(&pfd, 1, UP.timeout_ms) == 1 &&
+             getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &elen) == 0 && err == 0 ? 0 : -1;
+    }
+    if (rc < 0) { close(fd); return -1; }
+    fcntl(fd, F_SETFL, flags);
+    set_timeouts(fd);
+    return fd;
+}
+
+static int upstream_connect(void) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res = NULL;
+    if (getaddrinfo(UP.host, UP.port, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) fd = connect_timeout(ai);
+    freeaddrinfo(res);
+    return fd;
+}
+
+static void drop_connection(void) {
+    if (UP_FD >= 0) close(UP_FD);
+    UP_FD = -1;
+}
+
+static int send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* --------------------------- response --------------------------- */
+
+typedef struct {
+    char *buf;
+    size_t len, cap, pos;  // pos: first byte not yet consumed
+} rbuf;
+
+// read more bytes; 0 on EOF, -1 on error or timeout
+static int rbuf_fill(int fd, rbuf *b) {
+    if (b->len == b->cap) {
+        size_t ncap = b->cap ? b->cap * 2 : 8192;
+        if (ncap > UPSTREAM_MAX_HEAD + UPSTREAM_MAX_BODY + 8192) return -1;
+        char *p = (char*)realloc(b->buf, ncap);
+        if (!p) return -1;
+        b->buf = p;
+        b->cap = ncap;
+    }
+    for (;;) {
+        ssize_t n = recv(fd, b->buf + b->len, b->cap - b->len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        b->len += (size_t)n;
+        return n > 0;
+    }
+}
+
+// the next CRLF-terminated line starting at b->pos, reading as needed
+static char *rbuf_line(int fd, rbuf *b) {
+    for (;;) {
+        char *start = b->buf ? b->buf + b->pos : NULL;
+        char *nl = start ? memchr(start, '\n', b->len - b->pos) : NULL;
+        if (nl) {
+            b->pos = (size_t)(nl - b->buf) + 1;
+            if (nl > start && nl[-1] == '\r') nl--;
+            *nl = '\0';
+            return start;
+        }
+        if (b->len - b->pos > UPSTREAM_MAX_HEAD || rbuf_fill(fd, b) <= 0) return NULL;
+    }
+}
+
+// make sure n unconsumed bytes are buffered
+static bool rbuf_need(int fd, rbuf *b, size_t n) {
+    while (b->len - b->pos < n) if (rbuf_fill(fd, b) <= 0) return false;
+    return true;
+}
+
+static bool body_append(upstream_reply *out, const char *p, size_t n) {
+    if (out->body_len + n > UPSTREAM_MAX_BODY) return false;
+    char *nb = (char*)realloc(out->body, out->body_len + n + 1);
+    if (!nb) return false;
+    memcpy(nb + out->body_len, p, n);
+    out->body = nb;
+    out->body_len += n;
+    out->body[out->body_len] = '\0';
+    return true;
+}
+
+/* Status line, headers and body of one response. *keep tells whether the
+   connection can carry the next request; *got_any whether the server sent
+   anything at all (a reused connection closed by the server sends nothing). */
+static bool read_response(int fd, upstream_reply *out, bool *keep, bool *got_any) {
+    rbuf b = {0};
+    bool ok = false;
+    *keep = false;
+    char *line = rbuf_line(fd, &b);
+    *got_any = b.len > 0;
+    int minor = 0;
+    if (!line || sscanf(line, "HTTP/1.%d %d", &minor, &out->status) != 2) goto done;
+    *keep = minor >= 1;
+
+    bool chunked = false, have_length = false;
+    size_t length = 0;
+    while ((line = rbuf_line(fd, &b)) != NULL && *line) {
+        char *colon = strchr(line, ':');
+        if (!colon) continue;
+        *colon = '\0';
+        char *v = colon + 1;
+        while (*v == ' ' || *v == '\t') v++;
+        if (strcasecmp(line, "Content-Length") == 0) {
+            have_length = true;
+            length = (size_t)strtoull(v, NULL, 10);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+            chunked = strcasecmp(v, "chunked") == 0;
+        } else if (strcasecmp(line, "Connection") == 0) {
+            if (strcasecmp(v, "close") == 0) *keep = false;
+            else if (strcasecmp(v, "keep-alive") == 0) *keep = true;
+        } else if (strcasecmp(line, "Content-Type") == 0) {
+            size_t n = strcspn(v, "; ");
+            if (n >= sizeof(out->content_type)) n = sizeof(out->content_type) - 1;
+            memcpy(out->content_type, v, n);
+            out->content_type[n] = '\0';
+        }
+    }
+    if (!line) goto done;
+    if (!body_append(out, "", 0)) goto done;
+
+    if (chunked) {
+        for (;;) {
+            char *size_line = rbuf_line(fd, &b);
+            if (!size_line) goto done;
+            size_t n = (size_t)strtoull(size_line, NULL, 16);
+            if (n == 0) {
+                while ((line = rbuf_line(fd, &b)) != NULL && *line) {}  // trailers
+                if (!line) goto done;
+                break;
+            }
+            if (n > UPSTREAM_MAX_BODY || !rbuf_need(fd, &b, n + 2)) goto done;
+            if (!body_append(out, b.buf + b.pos, n)) goto done;
+            b.pos += n + 2;
+        }
+    } else if (have_length) {
+        if (length > UPSTREAM_MAX_BODY || !rbuf_need(fd, &b, length)) goto done;
+        if (!body_append(out, b.buf + b.pos, length)) goto done;
+        b.pos += length;
+    } else {
+        // delimited by the server closing the connection
+        *keep = false;
+        int r;
+        while ((r = rbuf_fill(fd, &b)) > 0) {}
+        if (r < 0 || !body_append(out, b.buf + b.pos, b.len - b.pos)) goto done;
+    }
+    ok = true;
+
+done:
+    free(b.buf);
+    return ok;
+}
+
+/* --------------------------- requests --------------------------- */
+
+void upstream_post(const char *body, size_t len, const char *content_type, const char *accept,
+                   upstream_reply *out) {
+    memset(out, 0, sizeof(*out));
+    if (!UP.enabled) { out->error = "no upstream configured"; return; }
+
+    char head[1024];
+    int hn = snprintf(head, sizeof(head),
+                      "POST %s HTTP/1.1\r\n"
+                      "Host: %s:%s\r\n"
+                      "Content-Type: %s\r\n"
+                      "Accept: %s\r\n"
+                      "Content-Length: %zu\r\n"
+                      "Connection: keep-alive\r\n"
+                      "\r\n",
+                      UP.path, UP.host, UP.port, content_type, accept, len);
+    if (hn < 0 || hn >= (int)sizeof(head)) { out->error = "upstream request too large"; return; }
+
+    // a kept connection may have been closed by the server meanwhile: retry once on a fresh one
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = UP_FD >= 0;
+        if (!reused && (UP_FD = upstream_connect()) < 0) {
+            out->error = "upstream connect failed";
+            return;
+        }
+        bool keep = false, got_any = false;
+        if (send_all(UP_FD, head, (size_t)hn) == 0 && send_all(UP_FD, body, len) == 0 &&
+            read_response(UP_FD, out, &keep, &got_any)) {
+            if (!keep) drop_connection();
+            return;
+        }
+        drop_connection();
+        upstream_reply_free(out);
+        out->status = 0;
+        out->content_type[0] = '\0';
+        if (!reused || got_any) break;
+    }
+    out->error = "upstream request failed";
+}
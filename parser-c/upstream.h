@@ -0,0 +1,28 @@
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Minimal blocking HTTP/1.1 client for the one upstream the parser talks
+   to (the analyzer). Each thread keeps its own keep-alive connection and
+   reconnects once when a reused connection turns out to be closed.
+   Connect, send and every read are bounded by the configured timeout. */
+
+typedef struct {
+    int status;             // HTTP status, 0 when the request failed
+    char *body;             // malloc'd and NUL-terminated (NULL when status == 0)
+    size_t body_len;
+    char content_type[64];  // media type of the body, "" if none was given
+    const char *error;      // static reason when status == 0
+} upstream_reply;
+
+// url is http://host[:port][/path]; returns -1 when it cannot be used
+int  upstream_init(const char *url, int timeout_ms);
+bool upstream_enabled(void);
+
+void upstream_post(const char *body, size_t len, const char *content_type, const char *accept,
+                   upstream_reply *out);
+void upstream_reply_free(upstream_reply *r);
+
+#endif
@@ -0,0 +1,169 @@
+#include "workpool.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+typedef struct {
+    workpool_fn fn;
+    void *ctx;
+    size_t pending;            // tasks not finished yet, guarded by mu
+    pthread_mutex_t mu;
+    pthread_cond_t done;
+} wp_job;
+
+typedef struct {
+    wp_job *job;
+    size_t index;
+} wp_task;
+
+// ring of tasks; the owner works at the bottom (tail), thieves at the top (head)
+typedef struct {
+    wp_task *items;
+    size_t head, len, cap;
+    pthread_mutex_t mu;
+} wp_deque;
+
+static struct {
+    wp_deque *deques;          // one per pool thread
+    size_t n;
+    atomic_size_t queued;      // tasks sitting in any deque
+    atomic_size_t next_deque;  // round-robin start for submissions
+    pthread_mutex_t idle_mu;
+    pthread_cond_t idle_cv;
+} WP = { .idle_mu = PTHREAD_MUTEX_INITIALIZER, .idle_cv = PTHREAD_COND_INITIALIZER };
+
+/* --------------------------- deques --------------------------- */
+
+static bool deque_push(wp_deque *d, wp_task t) {
+    pthread_mutex_lock(&d->mu);
+    if (d->len == d->cap) {
+        size_t ncap = d->cap ? d->cap * 2 : 64;
+        wp_task *items = (wp_task*)malloc(ncap * sizeof(wp_task));
+        if (!items) { pthread_mutex_unlock(&d->mu); return false; }
+        for (size_t i = 0; i < d->len; i++) items[i] = d->items[(d->head + i) % d->cap];
+        free(d->items);
+        d->items = items;
+        d->head = 0;
+        d->cap = ncap;
+    }
+    d->items[(d->head + d->len) % d->cap] = t;
+    d->len++;
+    pthread_mutex_unlock(&d->mu);
+    return true;
+}
+
+static bool deque_pop_bottom(wp_deque *d, wp_task *out) {
+    pthread_mutex_lock(&d->mu);
+    bool ok = d->len > 0;
+    if (ok) *out = d->items[(d->head + --d->len) % d->cap];
+    pthread_mutex_unlock(&d->mu);
+    return ok;
+}
+
+static bool deque_steal_top(wp_deque *d, wp_task *out) {
+    pthread_mutex_lock(&d->mu);
+    bool ok = d->len > 0;
+    if (ok) {
+        *out = d->items[d->head];
+        d->head = (d->head + 1) % d->cap;
+        d->len--;
+    }
+    pthread_mutex_unlock(&d->mu);
+    return ok;
+}
+
+// own deque first (self < WP.n), then steal round the others starting after self
+static bool take_task(size_t self, wp_task *out) {
+    if (atomic_load(&WP.queued) == 0) return false;
+    bool ok = self < WP.n && deque_pop_bottom(&WP.deques[self], out);
+    for (size_t k = 1; !ok && k <= WP.n; k++) {
+        size_t victim = (self + k) % WP.n;
+        if (victim != self) ok = deque_steal_top(&WP.deques[victim], out);
+    }
+    if (ok) atomic_fetch_sub(&WP.queued, 1);
+    return ok;
+}
+
+static void run_task(wp_task t) {
+    wp_job *job = t.job;
+    job->fn(job->ctx, t.index);
+    pthread_mutex_lock(&job->mu);
+    if (--job->pending == 0) pthread_cond_broadcast(&job->done);
+    pthread_mutex_unlock(&job->mu);
+}
+
+/* --------------------------- threads --------------------------- */
+
+static void *pool_main(void *arg) {
+    size_t self = (size_t)arg;
+    for (;;) {
+        wp_task t;
+        if (take_task(self, &t)) { run_task(t); continue; }
+        pthread_mutex_lock(&WP.idle_mu);
+        while (atomic_load(&WP.queued) == 0) pthread_cond_wait(&WP.idle_cv, &WP.idle_mu);
+        pthread_mutex_unlock(&WP.idle_mu);
+    }
+    return NULL;
+}
+
+int workpool_start(size_t threads) {
+    if (threads == 0 || WP.n) return 0;
+    WP.deques = (wp_deque*)calloc(threads, sizeof(wp_deque));
+    if (!WP.deques) return -1;
+    for (size_t i = 0; i < threads; i++) pthread_mutex_init(&WP.deques[i].mu, NULL);
+    for (size_t i = 0; i < threads; i++) {
+        pthread_t th;
+        // run with however many threads did start
+        if (pthread_create(&th, NULL, pool_main, (void*)i) != 0) break;
+        pthread_detach(th);
+        WP.n = i + 1;
+    }
+    return WP.n ? 0 : -1;
+}
+
+size_t workpool_threads(void) { return WP.n; }
+
+void workpool_run(size_t n, workpool_fn fn, void *ctx) {
+    if (n == 0) return;
+    if (WP.n == 0 || n == 1) {
+        for (size_t i = 0; i < n; i++) fn(ctx, i);
+        return;
+    }
+
+    wp_job job = { .fn = fn, .ctx = ctx, .pending = n };
+    pthread_mutex_init(&job.mu, NULL);
+    pthread_cond_init(&job.done, NULL);
+
+    // hand out contiguous blocks so neighbouring tasks start on the same thread
+    size_t first = atomic_fetch_add(&WP.next_deque, 1);
+    size_t block = (n + WP.n - 1) / WP.n;
+    for (size_t i = 0; i < n; i++) {
+        wp_task t = { &job, i };
+        atomic_fetch_add(&WP.queued, 1);  // before the push, so a thief never sees it go below zero
+        if (!deque_push(&WP.deques[(first + i / block) % WP.n], t)) {
+            atomic_fetch_sub(&WP.queued, 1);
+            run_task(t);  // no memory for the deque: do it here
+        }
+    }
+    pthread_mutex_lock(&WP.idle_mu);
+    pthread_cond_broadcast(&WP.idle_cv);
+    pthread_mutex_unlock(&WP.idle_mu);
+
+    // help: the submitter is not a pool thread, so it only ever steals
+    for (;;) {
+        pthread_mutex_lock(&job.mu);
+        bool finished = job.pending == 0;
+        pthread_mutex_unlock(&job.mu);
+        if (finished) break;
+        wp_task t;
+        if (take_task(WP.n, &t)) { run_task(t); continue; }
+        pthread_mutex_lock(&job.mu);
+        while (job.pending > 0) pthread_cond_wait(&job.done, &job.mu);
+        pthread_mutex_unlock(&job.mu);
+        break;
+    }
+
+    pthread_cond_destroy(&job.done);
+    pthread_mutex_destroy(&job.mu);
+}
@@ -0,0 +1,22 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stddef.h>
+
+/* Work-stealing pool for CPU-bound fan-out inside one request (e.g. one
+   task per top-level function of a large file). Each pool thread owns a
+   deque: it pops its own tasks newest-first and, when it runs dry, steals
+   the oldest task from another thread. The submitting thread helps until
+   its job is finished, so workpool_run() never deadlocks, even when every
+   pool thread is busy with other jobs. */
+
+typedef void (*workpool_fn)(void *ctx, size_t index);
+
+// start `threads` pool threads; 0 (or never calling it) runs every job inline
+int    workpool_start(size_t threads);
+size_t workpool_threads(void);
+
+// fn(ctx, i) for every i in [0, n), in any order and on any thread; returns when all are done
+void   workpool_run(size_t n, workpool_fn fn, void *ctx);
+
+#endif